@@ -1,66 +1,12 @@
 #include <iostream>
-#include <vector>
-#include <algorithm>
-#include <iterator>
-#include <memory>
-#include <mutex>
+#include <string>
 #include <thread>
-#include <list>
 
-template <class T, class mutex_type = std::mutex>
-class mutex {
-public:
-    explicit mutex(T&& t)
-            : t { std::move(t) } {}
-
-    mutex(mutex&& m)
-            : t { std::move(m.t) } {}
-
-    class mutexed_wrapper {
-    public:
-        explicit mutexed_wrapper(mutex& m)
-                : mutex_ { m }
-                , lock { mutex_.m } {}
-
-        mutexed_wrapper(mutexed_wrapper&& wrapper)
-                : mutex_ { wrapper.mutex_ }
-                , lock { mutex_.m } {}
-
-        T* operator->() {
-            return &mutex_.t;
-        }
-
-        T& operator*() {
-            return mutex_.t;
-        }
-
-        operator bool() {
-            return true;
-        }
-
-    private:
-        mutex& mutex_;
-        std::lock_guard<mutex_type> lock;
-    };
-
-    mutexed_wrapper lock() {
-        return mutexed_wrapper(*this);
-    }
-
-
-private:
-    T t;
-    mutex_type m;
-};
-
-template <class T>
-mutex<T> make_mutex(T&& t) {
-    return mutex<T>(std::move(t));
-}
+#include "mutex.h"
 
 int main() {
 
-    auto string = make_mutex(std::string("one"));
+    auto string = utils::make_mutex(std::string("one"));
 
 
     auto second = std::thread([&string](){
@@ -78,4 +24,4 @@ int main() {
     second.join();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,96 @@
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "active_object.h"
+#include "actor_stats.h"
+#include "bench.h"
+
+namespace {
+
+class Counter {
+public:
+    void add(int64_t value) { sum += value; }
+    int64_t get() { return sum; }
+private:
+    int64_t sum = 0;
+};
+
+// Round trip of a sync call to an idle actor.
+bench::Measurement sync_ping_pong(int64_t, const bench::Config& config) {
+    const auto calls = config.operations(100000);
+    utils::ActiveObject<Counter> actor;
+    utils::LatencyHistogram latencies;
+
+    const auto start = bench::Clock::now();
+    auto previous = start;
+    for (uint64_t i = 0; i < calls; ++i) {
+        actor.sync(&Counter::add, int64_t(1));
+        const auto now = bench::Clock::now();
+        latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - previous).count());
+        previous = now;
+    }
+
+    bench::Measurement measurement;
+    measurement.operations = calls;
+    measurement.elapsed = previous - start;
+    const auto snapshot = latencies.snapshot();
+    measurement.counters = {
+            { "p50_ns", double(snapshot.percentile(0.5)) },
+            { "p99_ns", double(snapshot.percentile(0.99)) },
+            { "p999_ns", double(snapshot.percentile(0.999)) },
+    };
+    return measurement;
+}
+
+// `producers` threads post async calls as fast as they can; the time is
+// until the actor ran the last one.
+template <template <class> class QueuePolicy>
+bench::Measurement async_throughput(int64_t producers, const bench::Config& config) {
+    const auto per_producer = config.operations(1 << 20) / producers;
+    utils::ActiveObject<Counter, QueuePolicy> actor;
+    std::promise<void> go;
+    const auto start_gate = go.get_future().share();
+
+    std::vector<std::thread> threads;
+    for (int64_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&actor, start_gate, per_producer](){
+            start_gate.wait();
+            for (uint64_t i = 0; i < per_producer; ++i) {
+                actor.async([](){}, &Counter::add, int64_t(1));
+            }
+        });
+    }
+
+    const auto start = bench::Clock::now();
+    go.set_value();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const auto total = actor.sync(&Counter::get);
+    const auto elapsed = bench::Clock::now() - start;
+
+    bench::Measurement measurement;
+    measurement.operations = static_cast<uint64_t>(total);
+    measurement.elapsed = elapsed;
+    return measurement;
+}
+
+const bench::Registration ping_pong {
+        "active_object/sync_ping_pong", {}, &sync_ping_pong
+};
+
+const bench::Registration concurrent_queue_throughput {
+        "active_object/async_throughput/concurrent_queue",
+        bench::powers_of_two(64),
+        &async_throughput<utils::ConcurrentQueue>
+};
+
+const bench::Registration mpsc_queue_throughput {
+        "active_object/async_throughput/mpsc_queue",
+        bench::powers_of_two(64),
+        &async_throughput<utils::MpscQueue>
+};
+
+} // namespace
@@ -0,0 +1,618 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "actor_stats.h"
+#include "bench.h"
+#include "growable_allocator.h"
+#include "merge_allocator.h"
+#include "thread_caching_allocator.h"
+
+// Usage: alloc_bench [--trace=file]... [--workload=name]... [--allocator=name]...
+//                    [--operations=N] [--live=N] [--samples=N] [--seed=N]
+//                    [--out=file.json]
+//
+// Replays allocation traces and synthetic workloads against the
+// allocators, once for throughput and once timing every operation while
+// sampling the footprint. Without --trace or --workload all synthetic
+// workloads run; without --allocator all allocators do.
+//
+// Workloads: uniform (1 - 1024 bytes, freed first in first out),
+// power_law (16 bytes - 64 KiB, mostly small, freed at random), lifo
+// (uniform sizes, last in first out), random_lifetime (uniform sizes,
+// freed at random). The live set swings between --live blocks and an
+// eighth of that, so footprints have spikes to come down from.
+//
+// Allocators: malloc, merge (MergeAllocator over an mmap arena),
+// growable (GrowableAllocator, giving free spans back to the kernel),
+// thread_caching (ThreadCachingAllocator, from one thread).
+//
+// Traces are text, an operation per line, '#' starts a comment:
+//     a <id> <size>    allocate size bytes, known as id until freed
+//     f <id>           free it
+// Ids are anything that fits 64 bits, addresses included; blocks still
+// live at the end are freed.
+//
+// The footprint is the growth of the resident set since the allocator was
+// set up, so arenas only count the pages touched; overhead is footprint
+// over live bytes. Latencies include reading the clock, ~20 ns.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t arena_size = size_t(1) << 30;
+
+struct Operation {
+    bool allocate;
+    uint32_t slot;
+    size_t size;
+};
+
+struct Workload {
+    std::string name;
+    std::vector<Operation> operations;
+    // slots are reused once free, this is how many there are
+    uint32_t slots = 0;
+};
+
+struct Options {
+    std::vector<std::string> traces;
+    std::vector<std::string> workloads;
+    std::vector<std::string> allocators;
+    std::string out;
+    size_t operations = 1000000;
+    size_t live = 20000;
+    size_t samples = 100;
+    uint32_t seed = 1;
+};
+
+
+// Dense indices for the live blocks, reused once freed, so the tables
+// indexed by them stay as small as the live set.
+class Slots {
+public:
+    uint32_t take() {
+        if (!free.empty()) {
+            const auto slot = free.back();
+            free.pop_back();
+            return slot;
+        }
+        return count++;
+    }
+
+    void give_back(uint32_t slot) {
+        free.push_back(slot);
+    }
+
+    uint32_t size() const {
+        return count;
+    }
+
+private:
+    std::vector<uint32_t> free;
+    uint32_t count = 0;
+};
+
+bool read_trace(const std::string& path, Workload& workload) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "can't read " << path << std::endl;
+        return false;
+    }
+    workload.name = path;
+    Slots slots;
+    std::unordered_map<uint64_t, uint32_t> live;
+    std::string line;
+    for (size_t number = 1; std::getline(in, line); ++number) {
+        const auto comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+        std::istringstream fields(line);
+        std::string kind;
+        std::string name;
+        if (!(fields >> kind)) {
+            continue;
+        }
+        size_t size = 0;
+        const bool valid = (kind == "a" && fields >> name >> size && size > 0)
+                || (kind == "f" && fields >> name);
+        char* end = nullptr;
+        // decimal, or hex with 0x like printed pointers
+        const uint64_t id = valid ? std::strtoull(name.c_str(), &end, 0) : 0;
+        if (!valid || *end != '\0') {
+            std::cerr << path << ":" << number << ": bad operation" << std::endl;
+            return false;
+        }
+        if (kind == "a") {
+            if (live.count(id) != 0) {
+                std::cerr << path << ":" << number << ": " << id << " is already live" << std::endl;
+                return false;
+            }
+            const auto slot = slots.take();
+            live.emplace(id, slot);
+            workload.operations.push_back(Operation { true, slot, size });
+        } else {
+            const auto found = live.find(id);
+            if (found == live.end()) {
+                std::cerr << path << ":" << number << ": " << id << " isn't live" << std::endl;
+                return false;
+            }
+            workload.operations.push_back(Operation { false, found->second, 0 });
+            slots.give_back(found->second);
+            live.erase(found);
+        }
+    }
+    for (const auto& block : live) {
+        workload.operations.push_back(Operation { false, block.second, 0 });
+    }
+    workload.slots = slots.size();
+    return true;
+}
+
+
+enum class Sizes { uniform, power_law };
+enum class Order { fifo, lifo, random };
+
+Workload synthetic(const std::string& name, Sizes sizes, Order order, const Options& options) {
+    std::mt19937_64 random(options.seed);
+    std::uniform_int_distribution<size_t> uniform(1, 1024);
+    std::uniform_real_distribution<double> unit(0, 1);
+    const auto size = [&]() -> size_t {
+        if (sizes == Sizes::uniform) {
+            return uniform(random);
+        }
+        // Pareto, alpha 1.2, from 16 bytes on, capped at 64 KiB
+        const auto value = 16 / std::pow(1 - unit(random), 1 / 1.2);
+        return static_cast<size_t>(std::min(value, 65536.0));
+    };
+
+    Workload workload { name, {}, 0 };
+    Slots slots;
+    std::deque<uint32_t> live;
+    const auto phase = std::max<size_t>(options.operations / 8, 1);
+    for (size_t i = 0; i < options.operations; ++i) {
+        const auto target = (i / phase) % 2 == 0 ? options.live : options.live / 8;
+        const bool allocate = live.empty() || unit(random) < (live.size() < target ? 0.75 : 0.25);
+        if (allocate) {
+            const auto slot = slots.take();
+            live.push_back(slot);
+            workload.operations.push_back(Operation { true, slot, size() });
+            continue;
+        }
+        if (order == Order::random) {
+            std::swap(live[random() % live.size()], live.back());
+        }
+        const auto slot = order == Order::fifo ? live.front() : live.back();
+        if (order == Order::fifo) {
+            live.pop_front();
+        } else {
+            live.pop_back();
+        }
+        workload.operations.push_back(Operation { false, slot, 0 });
+        slots.give_back(slot);
+    }
+    for (const auto slot : live) {
+        workload.operations.push_back(Operation { false, slot, 0 });
+    }
+    workload.slots = slots.size();
+    return workload;
+}
+
+const std::vector<std::pair<std::string, std::function<Workload(const Options&)>>>& synthetic_workloads() {
+    static const std::vector<std::pair<std::string, std::function<Workload(const Options&)>>> workloads {
+        { "uniform", [](const Options& options){ return synthetic("uniform", Sizes::uniform, Order::fifo, options); } },
+        { "power_law", [](const Options& options){ return synthetic("power_law", Sizes::power_law, Order::random, options); } },
+        { "lifo", [](const Options& options){ return synthetic("lifo", Sizes::uniform, Order::lifo, options); } },
+        { "random_lifetime", [](const Options& options){ return synthetic("random_lifetime", Sizes::uniform, Order::random, options); } },
+    };
+    return workloads;
+}
+
+
+class Target {
+public:
+    virtual ~Target() = default;
+    virtual char* allocate(size_t size) noexcept = 0;
+    virtual void deallocate(char* ptr, size_t size) noexcept = 0;
+    // as the allocator sees it, negative if it can't tell
+    virtual double fragmentation() const noexcept {
+        return -1;
+    }
+};
+
+class Malloc
+    : public Target {
+public:
+    char* allocate(size_t size) noexcept override {
+        return static_cast<char*>(std::malloc(size));
+    }
+
+    void deallocate(char* ptr, size_t) noexcept override {
+        std::free(ptr);
+    }
+};
+
+class Merge
+    : public Target {
+public:
+    Merge()
+        : arena { arena_size, HugePages::none, 0 }
+        , allocator { arena } {}
+
+    char* allocate(size_t size) noexcept override {
+        return allocator.allocate(size);
+    }
+
+    void deallocate(char* ptr, size_t size) noexcept override {
+        allocator.deallocate(ptr, size);
+    }
+
+    double fragmentation() const noexcept override {
+        return allocator.stats().fragmentation;
+    }
+
+private:
+    MmapArena arena;
+    MergeAllocator allocator;
+};
+
+class Growable
+    : public Target {
+public:
+    char* allocate(size_t size) noexcept override {
+        return allocator.allocate(size);
+    }
+
+    void deallocate(char* ptr, size_t size) noexcept override {
+        allocator.deallocate(ptr, size);
+    }
+
+private:
+    GrowableAllocator allocator;
+};
+
+class ThreadCaching
+    : public Target {
+public:
+    ThreadCaching()
+        : arena { arena_size, HugePages::none, 0 }
+        , allocator { arena } {}
+
+    char* allocate(size_t size) noexcept override {
+        return allocator.allocate(size);
+    }
+
+    void deallocate(char* ptr, size_t size) noexcept override {
+        allocator.deallocate(ptr, size);
+    }
+
+private:
+    MmapArena arena;
+    ThreadCachingAllocator allocator;
+};
+
+template <class T>
+std::unique_ptr<Target> make() {
+    return std::unique_ptr<Target>(new T);
+}
+
+const std::vector<std::pair<std::string, std::function<std::unique_ptr<Target>()>>>& allocators() {
+    static const std::vector<std::pair<std::string, std::function<std::unique_ptr<Target>()>>> targets {
+        { "malloc", make<Malloc> },
+        { "merge", make<Merge> },
+        { "growable", make<Growable> },
+        { "thread_caching", make<ThreadCaching> },
+    };
+    return targets;
+}
+
+
+size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+struct Sample {
+    size_t operation;
+    size_t live_bytes;
+    size_t footprint;
+    double fragmentation;
+};
+
+struct Result {
+    std::string workload;
+    std::string allocator;
+    size_t operations = 0;
+    double seconds = 0;
+    size_t failures = 0;
+    utils::HistogramSnapshot allocate_ns;
+    utils::HistogramSnapshot deallocate_ns;
+    size_t peak_live_bytes = 0;
+    size_t peak_footprint = 0;
+    std::vector<Sample> samples;
+};
+
+// Returns how many allocations failed; the frees of those are skipped.
+// Pointers and sizes are per slot.
+template <class Timer>
+size_t replay(Target& target, const Workload& workload, std::vector<char*>& blocks, std::vector<size_t>& sizes, Timer&& timer) {
+    size_t failures = 0;
+    for (size_t i = 0; i < workload.operations.size(); ++i) {
+        const auto& operation = workload.operations[i];
+        bool done = false;
+        if (operation.allocate) {
+            const auto started = timer.start();
+            const auto ptr = target.allocate(operation.size);
+            timer.allocated(started);
+            bench::do_not_optimize(ptr);
+            blocks[operation.slot] = ptr;
+            sizes[operation.slot] = operation.size;
+            done = ptr != nullptr;
+            failures += done ? 0 : 1;
+        } else if (blocks[operation.slot] != nullptr) {
+            const auto started = timer.start();
+            target.deallocate(blocks[operation.slot], sizes[operation.slot]);
+            timer.deallocated(started);
+            blocks[operation.slot] = nullptr;
+            done = true;
+        }
+        timer.after(i, operation, done);
+    }
+    return failures;
+}
+
+struct Untimed {
+    int start() const { return 0; }
+    void allocated(int) const {}
+    void deallocated(int) const {}
+    void after(size_t, const Operation&, bool /*done*/) const {}
+};
+
+struct Timed {
+    Clock::time_point start() const {
+        return Clock::now();
+    }
+
+    void allocated(Clock::time_point started) {
+        allocate_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+    }
+
+    void deallocated(Clock::time_point started) {
+        deallocate_ns.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+    }
+
+    void after(size_t i, const Operation& operation, bool done) {
+        if (done) {
+            live_bytes = operation.allocate ? live_bytes + operation.size : live_bytes - (*sizes)[operation.slot];
+        }
+        result->peak_live_bytes = std::max(result->peak_live_bytes, live_bytes);
+        if (i % sample_every == 0 || i + 1 == total) {
+            const auto resident = resident_bytes();
+            const auto footprint = resident > baseline ? resident - baseline : 0;
+            result->peak_footprint = std::max(result->peak_footprint, footprint);
+            result->samples.push_back(Sample { i, live_bytes, footprint, target->fragmentation() });
+        }
+    }
+
+    utils::LatencyHistogram allocate_ns;
+    utils::LatencyHistogram deallocate_ns;
+    const std::vector<size_t>* sizes;
+    Result* result;
+    const Target* target;
+    size_t baseline;
+    size_t sample_every;
+    size_t total;
+    size_t live_bytes = 0;
+};
+
+void trim() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+Result run(const Workload& workload, const std::pair<std::string, std::function<std::unique_ptr<Target>()>>& allocator, const Options& options) {
+    Result result;
+    result.workload = workload.name;
+    result.allocator = allocator.first;
+    result.operations = workload.operations.size();
+    std::vector<char*> blocks(workload.slots, nullptr);
+    std::vector<size_t> sizes(workload.slots, 0);
+
+    {
+        trim();
+        const auto target = allocator.second();
+        const auto started = Clock::now();
+        result.failures = replay(*target, workload, blocks, sizes, Untimed {});
+        result.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    }
+
+    trim();
+    const auto target = allocator.second();
+    std::unique_ptr<Timed> timer(new Timed);
+    timer->sizes = &sizes;
+    timer->result = &result;
+    timer->target = target.get();
+    timer->baseline = resident_bytes();
+    timer->sample_every = std::max<size_t>(workload.operations.size() / std::max<size_t>(options.samples, 1), 1);
+    timer->total = workload.operations.size();
+    replay(*target, workload, blocks, sizes, *timer);
+    result.allocate_ns = timer->allocate_ns.snapshot();
+    result.deallocate_ns = timer->deallocate_ns.snapshot();
+    return result;
+}
+
+
+bool starts_with(const char* arg, const char* prefix, std::string& value) {
+    const auto length = std::strlen(prefix);
+    if (std::strncmp(arg, prefix, length) != 0) {
+        return false;
+    }
+    value = arg + length;
+    return true;
+}
+
+bool parse(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        if (starts_with(argv[i], "--trace=", value)) {
+            options.traces.push_back(value);
+        } else if (starts_with(argv[i], "--workload=", value)) {
+            options.workloads.push_back(value);
+        } else if (starts_with(argv[i], "--allocator=", value)) {
+            options.allocators.push_back(value);
+        } else if (starts_with(argv[i], "--operations=", value)) {
+            options.operations = std::stoull(value);
+        } else if (starts_with(argv[i], "--live=", value)) {
+            options.live = std::max<size_t>(std::stoull(value), 8);
+        } else if (starts_with(argv[i], "--samples=", value)) {
+            options.samples = std::stoull(value);
+        } else if (starts_with(argv[i], "--seed=", value)) {
+            options.seed = static_cast<uint32_t>(std::stoul(value));
+        } else if (starts_with(argv[i], "--out=", value)) {
+            options.out = value;
+        } else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool selected(const std::vector<std::string>& names, const std::string& name) {
+    return names.empty() || std::find(names.begin(), names.end(), name) != names.end();
+}
+
+void write_latencies(std::ostream& out, const char* name, const utils::HistogramSnapshot& latencies) {
+    out << "      \"" << name << "\": { "
+        << "\"p50\": " << latencies.percentile(0.5) << ", "
+        << "\"p99\": " << latencies.percentile(0.99) << ", "
+        << "\"p999\": " << latencies.percentile(0.999) << ", "
+        << "\"max\": " << (latencies.buckets.empty() ? 0 : latencies.buckets.back().first) << " },\n";
+}
+
+void write_json(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+    char date[32];
+    const auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+#ifdef NDEBUG
+    out << "    \"assertions\": false,\n";
+#else
+    out << "    \"assertions\": true,\n";
+#endif
+    out << "    \"seed\": " << options.seed << "\n";
+    out << "  },\n";
+    out << "  \"runs\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"workload\": \"" << result.workload << "\",\n";
+        out << "      \"allocator\": \"" << result.allocator << "\",\n";
+        out << "      \"operations\": " << result.operations << ",\n";
+        out << "      \"seconds\": " << result.seconds << ",\n";
+        out << "      \"ops_per_second\": " << result.operations / result.seconds << ",\n";
+        out << "      \"failures\": " << result.failures << ",\n";
+        write_latencies(out, "allocate_ns", result.allocate_ns);
+        write_latencies(out, "deallocate_ns", result.deallocate_ns);
+        out << "      \"peak_live_bytes\": " << result.peak_live_bytes << ",\n";
+        out << "      \"peak_footprint_bytes\": " << result.peak_footprint << ",\n";
+        out << "      \"samples\": [";
+        for (size_t j = 0; j < result.samples.size(); ++j) {
+            const auto& sample = result.samples[j];
+            out << (j == 0 ? "\n" : ",\n");
+            out << "        { \"operation\": " << sample.operation
+                << ", \"live_bytes\": " << sample.live_bytes
+                << ", \"footprint_bytes\": " << sample.footprint;
+            if (sample.fragmentation >= 0) {
+                out << ", \"fragmentation\": " << sample.fragmentation;
+            }
+            out << " }";
+        }
+        out << "\n      ]\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        return 2;
+    }
+
+    std::vector<Workload> workloads;
+    for (const auto& path : options.traces) {
+        workloads.emplace_back();
+        if (!read_trace(path, workloads.back())) {
+            return 2;
+        }
+    }
+    if (options.traces.empty() || !options.workloads.empty()) {
+        for (const auto& workload : synthetic_workloads()) {
+            if (selected(options.workloads, workload.first)) {
+                workloads.push_back(workload.second(options));
+            }
+        }
+    }
+
+    std::vector<Result> results;
+    for (const auto& workload : workloads) {
+        for (const auto& allocator : allocators()) {
+            if (!selected(options.allocators, allocator.first)) {
+                continue;
+            }
+            results.push_back(run(workload, allocator, options));
+            const auto& result = results.back();
+            std::cerr << result.workload << "/" << result.allocator << ": "
+                      << result.operations / result.seconds / 1e6 << " Mops/s, "
+                      << "allocate p99 " << result.allocate_ns.percentile(0.99) << " ns, "
+                      << "peak " << result.peak_footprint / 1024 << " KiB for "
+                      << result.peak_live_bytes / 1024 << " KiB live"
+                      << (result.failures != 0 ? ", " + std::to_string(result.failures) + " failed" : "")
+                      << std::endl;
+        }
+    }
+
+    if (options.out.empty()) {
+        write_json(std::cout, options, results);
+    } else {
+        std::ofstream out(options.out);
+        write_json(out, options, results);
+        if (!out) {
+            std::cerr << "failed to write " << options.out << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef CPP_UTILS_BENCH_H
+#define CPP_UTILS_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Minimal benchmark harness for cpp_utils_bench: benchmarks register
+// themselves with a Registration at namespace scope, main runs them and
+// writes the results as JSON.
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    // multiplies every benchmark's default operation count
+    double scale = 1.0;
+
+    uint64_t operations(uint64_t default_count) const {
+        const auto scaled = static_cast<uint64_t>(default_count * scale);
+        return scaled > 0 ? scaled : 1;
+    }
+};
+
+struct Measurement {
+    uint64_t operations = 0;
+    Clock::duration elapsed { 0 };
+    // reported next to the timing, e.g. latency percentiles
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+// Runs one repetition for the given argument (thread count, size, ...).
+using Function = std::function<Measurement(int64_t arg, const Config& config)>;
+
+struct Benchmark {
+    std::string name;
+    // one run per argument, none means a single run without one
+    std::vector<int64_t> args;
+    Function run;
+};
+
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registration {
+    Registration(std::string name, std::vector<int64_t> args, Function run) {
+        registry().push_back(Benchmark { std::move(name), std::move(args), std::move(run) });
+    }
+};
+
+// 1, 2, 4, ... up to max
+inline std::vector<int64_t> powers_of_two(int64_t max) {
+    std::vector<int64_t> values;
+    for (int64_t value = 1; value <= max; value *= 2) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+// Keeps the compiler from dropping a computation whose result is unused.
+template <class T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+
+#endif //CPP_UTILS_BENCH_H
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+// Usage: cpp_utils_bench [--filter=substring] [--repetitions=N]
+//                        [--scale=X] [--out=file.json]
+//
+// Every benchmark runs once to warm up, then N times; the repetition with
+// the median time per operation is reported. Progress goes to stderr, the
+// JSON to stdout or --out.
+
+namespace {
+
+struct Options {
+    std::string filter;
+    std::string out;
+    int repetitions = 5;
+    bench::Config config;
+};
+
+struct Result {
+    std::string name;
+    bool has_arg;
+    int64_t arg;
+    std::vector<bench::Measurement> repetitions;
+};
+
+double ns_per_op(const bench::Measurement& m) {
+    return std::chrono::duration<double, std::nano>(m.elapsed).count() / m.operations;
+}
+
+bool starts_with(const char* arg, const char* prefix, std::string& value) {
+    const auto length = std::strlen(prefix);
+    if (std::strncmp(arg, prefix, length) != 0) {
+        return false;
+    }
+    value = arg + length;
+    return true;
+}
+
+bool parse(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        if (starts_with(argv[i], "--filter=", value)) {
+            options.filter = value;
+        } else if (starts_with(argv[i], "--out=", value)) {
+            options.out = value;
+        } else if (starts_with(argv[i], "--repetitions=", value)) {
+            options.repetitions = std::max(1, std::stoi(value));
+        } else if (starts_with(argv[i], "--scale=", value)) {
+            options.config.scale = std::stod(value);
+        } else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string full_name(const Result& result) {
+    return result.has_arg ? result.name + "/" + std::to_string(result.arg) : result.name;
+}
+
+void write_json(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+    char date[32];
+    const auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"assertions\": false,\n";
+#else
+    out << "    \"assertions\": true,\n";
+#endif
+    out << "    \"repetitions\": " << options.repetitions << ",\n";
+    out << "    \"scale\": " << options.config.scale << "\n";
+    out << "  },\n";
+    out << "  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        auto sorted = result.repetitions;
+        std::sort(sorted.begin(), sorted.end(), [](const bench::Measurement& a, const bench::Measurement& b){
+            return ns_per_op(a) < ns_per_op(b);
+        });
+        const auto& median = sorted[sorted.size() / 2];
+        const auto seconds = std::chrono::duration<double>(median.elapsed).count();
+
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"name\": \"" << full_name(result) << "\",\n";
+        out << "      \"family\": \"" << result.name << "\",\n";
+        if (result.has_arg) {
+            out << "      \"arg\": " << result.arg << ",\n";
+        }
+        out << "      \"operations\": " << median.operations << ",\n";
+        out << "      \"seconds\": " << seconds << ",\n";
+        out << "      \"ns_per_op\": " << ns_per_op(median) << ",\n";
+        out << "      \"min_ns_per_op\": " << ns_per_op(sorted.front()) << ",\n";
+        out << "      \"max_ns_per_op\": " << ns_per_op(sorted.back()) << ",\n";
+        out << "      \"ops_per_second\": " << median.operations / seconds;
+        for (const auto& counter : median.counters) {
+            out << ",\n      \"" << counter.first << "\": " << counter.second;
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        return 2;
+    }
+
+    std::vector<Result> results;
+    for (const auto& benchmark : bench::registry()) {
+        auto args = benchmark.args;
+        const bool has_arg = !args.empty();
+        if (!has_arg) {
+            args.push_back(0);
+        }
+        for (const auto arg : args) {
+            Result result { benchmark.name, has_arg, arg, {} };
+            const auto name = full_name(result);
+            if (name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            benchmark.run(arg, options.config);
+            for (int i = 0; i < options.repetitions; ++i) {
+                result.repetitions.push_back(benchmark.run(arg, options.config));
+            }
+            std::cerr << name << ": " << ns_per_op(result.repetitions.back()) << " ns/op" << std::endl;
+            results.push_back(std::move(result));
+        }
+    }
+
+    if (options.out.empty()) {
+        write_json(std::cout, options, results);
+    } else {
+        std::ofstream out(options.out);
+        write_json(out, options, results);
+        if (!out) {
+            std::cerr << "failed to write " << options.out << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
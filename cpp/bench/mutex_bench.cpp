@@ -0,0 +1,46 @@
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "mutex.h"
+
+namespace {
+
+// `threads` threads increment one counter behind utils::mutex; ns_per_op
+// over the thread count is the contention curve.
+bench::Measurement contention(int64_t threads, const bench::Config& config) {
+    const auto per_thread = config.operations(1 << 20) / threads;
+    auto counter = utils::make_mutex(uint64_t(0));
+    std::promise<void> go;
+    const auto start_gate = go.get_future().share();
+
+    std::vector<std::thread> workers;
+    for (int64_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&counter, start_gate, per_thread](){
+            start_gate.wait();
+            for (uint64_t i = 0; i < per_thread; ++i) {
+                ++*counter.lock();
+            }
+        });
+    }
+
+    const auto start = bench::Clock::now();
+    go.set_value();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    const auto elapsed = bench::Clock::now() - start;
+
+    bench::Measurement measurement;
+    measurement.operations = *counter.lock();
+    measurement.elapsed = elapsed;
+    return measurement;
+}
+
+const bench::Registration mutex_contention {
+        "mutex/contention", bench::powers_of_two(64), &contention
+};
+
+} // namespace
@@ -0,0 +1,106 @@
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "concurrent_queue.h"
+
+namespace {
+
+template <class T>
+using Bounded1024 = utils::BoundedQueue<T, 1024, utils::Overflow::Block>;
+
+// Uncontended cost of moving an element through the queue: pushes a batch
+// and drains it on the same thread.
+template <template <class> class Queue>
+bench::Measurement push_pop(int64_t batch, const bench::Config& config) {
+    const auto rounds = config.operations(1 << 20) / batch;
+    Queue<uint64_t> queue;
+    uint64_t sum = 0;
+
+    const auto start = bench::Clock::now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (int64_t i = 0; i < batch; ++i) {
+            queue.push(uint64_t(i));
+        }
+        queue.try_drain([&sum](uint64_t& value){
+            sum += value;
+            return true;
+        }, batch);
+    }
+    const auto elapsed = bench::Clock::now() - start;
+    bench::do_not_optimize(sum);
+
+    bench::Measurement measurement;
+    measurement.operations = rounds * batch;
+    measurement.elapsed = elapsed;
+    return measurement;
+}
+
+// `producers` threads push while one consumer drains in batches of 64.
+template <template <class> class Queue>
+bench::Measurement transfer(int64_t producers, const bench::Config& config) {
+    const auto per_producer = config.operations(1 << 20) / producers;
+    const auto total = per_producer * producers;
+    Queue<uint64_t> queue;
+    std::promise<void> go;
+    const auto start_gate = go.get_future().share();
+
+    std::vector<std::thread> threads;
+    for (int64_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, start_gate, per_producer](){
+            start_gate.wait();
+            for (uint64_t i = 0; i < per_producer; ++i) {
+                queue.push(uint64_t(i));
+            }
+        });
+    }
+
+    const auto start = bench::Clock::now();
+    go.set_value();
+    uint64_t received = 0;
+    while (received < total) {
+        queue.drain([&received](uint64_t&){
+            ++received;
+            return true;
+        }, 64);
+    }
+    const auto elapsed = bench::Clock::now() - start;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bench::Measurement measurement;
+    measurement.operations = total;
+    measurement.elapsed = elapsed;
+    return measurement;
+}
+
+const std::vector<int64_t> batches { 1, 64 };
+
+const bench::Registration concurrent_queue_push_pop {
+        "queue/push_pop/concurrent_queue", batches, &push_pop<utils::ConcurrentQueue>
+};
+
+const bench::Registration mpsc_queue_push_pop {
+        "queue/push_pop/mpsc_queue", batches, &push_pop<utils::MpscQueue>
+};
+
+const bench::Registration bounded_queue_push_pop {
+        "queue/push_pop/bounded_queue", batches, &push_pop<Bounded1024>
+};
+
+const bench::Registration concurrent_queue_transfer {
+        "queue/transfer/concurrent_queue", bench::powers_of_two(8), &transfer<utils::ConcurrentQueue>
+};
+
+const bench::Registration mpsc_queue_transfer {
+        "queue/transfer/mpsc_queue", bench::powers_of_two(8), &transfer<utils::MpscQueue>
+};
+
+const bench::Registration bounded_queue_transfer {
+        "queue/transfer/bounded_queue", bench::powers_of_two(8), &transfer<Bounded1024>
+};
+
+} // namespace
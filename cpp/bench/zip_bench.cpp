@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "bench.h"
+#include "zip.h"
+
+namespace {
+
+// z = a * x + y over float columns of `size` elements, once written as an
+// indexed loop and once over utils::zip; in an optimized build both should
+// be vectorized and run at the same speed.
+
+struct Columns {
+    explicit Columns(int64_t size)
+        : x(size, 1.5f)
+        , y(size, 2.0f)
+        , z(size, 0.0f) {}
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+};
+
+template <class Loop>
+bench::Measurement saxpy(int64_t size, const bench::Config& config, Loop loop) {
+    Columns columns(size);
+    const auto rounds = config.operations(1 << 26) / size;
+
+    const auto start = bench::Clock::now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        loop(columns, 0.5f + round % 2);
+        bench::do_not_optimize(columns.z.data());
+    }
+    const auto elapsed = bench::Clock::now() - start;
+
+    bench::Measurement measurement;
+    measurement.operations = rounds * size;
+    measurement.elapsed = elapsed;
+    return measurement;
+}
+
+void indexedLoop(Columns& columns, float a) {
+    const auto size = columns.z.size();
+    for (std::size_t i = 0; i < size; ++i) {
+        columns.z[i] = a * columns.x[i] + columns.y[i];
+    }
+}
+
+void zippedLoop(Columns& columns, float a) {
+    for (auto&& row : utils::zip(columns.x, columns.y, columns.z)) {
+        std::get<2>(row) = a * std::get<0>(row) + std::get<1>(row);
+    }
+}
+
+const std::vector<int64_t> sizes { 1 << 10, 1 << 14, 1 << 20 };
+
+const bench::Registration indexed {
+        "zip/saxpy_indexed", sizes, [](int64_t size, const bench::Config& config) {
+            return saxpy(size, config, &indexedLoop);
+        }
+};
+
+const bench::Registration zipped {
+        "zip/saxpy_zipped", sizes, [](int64_t size, const bench::Config& config) {
+            return saxpy(size, config, &zippedLoop);
+        }
+};
+
+} // namespace
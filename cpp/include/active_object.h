@@ -2,184 +2,629 @@
 #define CPP_UTILS_ACTIVE_OBJECT_H
 
 #include <iostream>
+#include <algorithm>
 #include <thread>
 #include <future>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <cstdint>
 #include <cassert>
+#include <chrono>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <optional>
+#endif
+
+#include "actor_stats.h"
+#include "concurrent_queue.h"
+#include "future.h"
+#include "small_function.h"
+#include "thread_pool.h"
 
 
 namespace utils {
 
-template <class T>
-class ConcurrentQueue
-        : public std::enable_shared_from_this<ConcurrentQueue<T>> {
-public:
-    void push(T&& elem) {
-        {
-            std::lock_guard<std::mutex> guard(mutex);
-            queue.push(elem);
-        }
-        condition_variable.notify_one();
-    }
-
-    template <class CALLBACK>
-    void clear(CALLBACK callback) {
-        std::queue<T> old_queue;
-        {
-            std::lock_guard<std::mutex> guard(mutex);
-            std::swap(old_queue, queue);
-        }
-
-        while (!old_queue.empty()) {
-            auto elem = std::move(old_queue.front());
-            old_queue.pop();
-
-            callback(elem);
-        }
-    }
-
-    template <class CALLBACK>
-    void wait(CALLBACK callback) {
-        std::unique_lock<std::mutex> lock(mutex);
-        condition_variable.wait(lock, [this](){
-            return !queue.empty();
-        });
+// Tag for constructing an ActiveObject on a shared ThreadPool instead of a
+// dedicated thread.
+struct executor_arg_t {
+    explicit executor_arg_t() = default;
+};
 
-        auto elem = std::move(queue.front());
-        queue.pop();
-        lock.unlock();
+constexpr executor_arg_t executor_arg {};
 
-        callback(elem);
-    }
+// Per-call scheduling hints, passed as the first argument of sync, async
+// and try_post. A prioritized mailbox serves higher priorities first; a
+// call still queued past its deadline is not run and completes with
+// TimeoutError.
+struct CallOptions {
+    using Clock = std::chrono::steady_clock;
 
-private:
-    std::queue<T> queue;
-    std::mutex mutex;
-    std::condition_variable condition_variable;
+    unsigned priority = 0;
+    Clock::time_point deadline = Clock::time_point::max();
 };
 
-
-template <class O>
+inline CallOptions priority(unsigned priority) {
+    CallOptions options;
+    options.priority = priority;
+    return options;
+}
+
+inline CallOptions deadline(CallOptions::Clock::time_point deadline) {
+    CallOptions options;
+    options.deadline = deadline;
+    return options;
+}
+
+template <class Rep, class Period>
+CallOptions timeout(std::chrono::duration<Rep, Period> timeout) {
+    return deadline(CallOptions::Clock::now() + timeout);
+}
+
+// QueuePolicy is the mailbox implementation: ConcurrentQueue (mutex based),
+// MpscQueue (lock-free, for heavy fan-in), Bounded<N, Overflow>::type
+// (fixed capacity with backpressure) or Prioritized<N>::type (N lanes).
+// Stats is the instrumentation: NoStats compiles to nothing, ActorStats
+// records queue depth and latency histograms, see stats().
+template <class O, template <class> class QueuePolicy = ConcurrentQueue, class Stats = NoStats>
 class ActiveObject {
 private:
-    struct Message {
+    // The stamp is a base so that an empty one takes no space.
+    struct Message : Stats::Stamp {
         enum class Type : uint8_t {
             Action,
             Stop
         };
-        using ActionT = std::function<void(O&)>;
+        // Captures of a few pointers and arguments are stored inline. The
+        // task gets nullptr instead of the object when its deadline passed.
+        using ActionT = SmallFunction<void(O*), 48>;
+
+        Message() = default;
+
+        Message(Type type, uint8_t priority, CallOptions::Clock::time_point deadline, ActionT task)
+                : type { type }
+                , priority { priority }
+                , deadline { deadline }
+                , task { std::move(task) }
+        {}
 
         Type type;
+        uint8_t priority;
+        CallOptions::Clock::time_point deadline;
         ActionT task;
 
-        static Message action(ActionT task) {
-            return Message{Type::Action, task};
+        template <class F>
+        static Message action(const CallOptions& options, F&& task) {
+            const auto lane = std::min<unsigned>(options.priority, std::numeric_limits<uint8_t>::max());
+            return Message(Type::Action, static_cast<uint8_t>(lane), options.deadline, ActionT(std::forward<F>(task)));
         }
 
         static Message stop() {
-            return Message{Type::Stop};
+            return Message(Type::Stop, 0, CallOptions::Clock::time_point::max(), nullptr);
+        }
+
+        bool expired() const {
+            return deadline != CallOptions::Clock::time_point::max()
+                   && CallOptions::Clock::now() > deadline;
+        }
+    };
+
+    using Queue = QueuePolicy<Message>;
+
+    // Method call posted by async: owns the callback and decayed copies of
+    // the arguments, so it can be moved into the message without std::bind.
+    template <class C, class T, class... Params>
+    struct AsyncCall {
+        C callback;
+        T (O::*f)(Params...);
+        std::tuple<typename std::decay<Params>::type...> args;
+
+        void operator()(O* object) {
+            if (object != nullptr) {
+                run(*object, std::is_void<T>{}, std::index_sequence_for<Params...>{});
+            }
+        }
+
+        template <std::size_t... I>
+        void run(O& object, std::false_type, std::index_sequence<I...>) {
+            callback((object.*f)(std::forward<Params>(std::get<I>(args))...));
+        }
+
+        template <std::size_t... I>
+        void run(O& object, std::true_type, std::index_sequence<I...>) {
+            (object.*f)(std::forward<Params>(std::get<I>(args))...);
+            callback();
+        }
+    };
+
+    // Runs the object on a ThreadPool. The actor is scheduled as one task
+    // while its mailbox is non-empty, so messages still run one at a time
+    // and in order, on whichever worker picked it up.
+    class PooledActor
+            : public ThreadPool::Task
+            , public std::enable_shared_from_this<PooledActor> {
+    public:
+        // per scheduling, so one busy actor can't hog a worker
+        static constexpr std::size_t quantum = 64;
+
+        template <class... Args>
+        PooledActor(std::shared_ptr<Queue> queue,
+                    ThreadPool& pool,
+                    const std::atomic<std::size_t>& max_batch,
+                    Stats& stats,
+                    Args&&... args)
+                : queue { std::move(queue) }
+                , pool { pool }
+                , max_batch { max_batch }
+                , stats { stats } {
+            new (&storage) O{ std::forward<Args>(args)... };
         }
+
+        ~PooledActor() {
+            if (!stopped) {
+                object().~O();
+            }
+        }
+
+        void notify() {
+            if (state.exchange(notified, std::memory_order_seq_cst) == idle) {
+                keep_alive = this->shared_from_this();
+                pool.schedule(this);
+            }
+        }
+
+        std::future<void> done() {
+            return finished.get_future();
+        }
+
+        void run() override {
+            const auto self = std::move(keep_alive);
+            const auto batch = max_batch.load(std::memory_order_relaxed);
+            // a post from here on is either drained below or leaves the
+            // state notified
+            state.store(running, std::memory_order_seq_cst);
+
+            std::size_t processed = 0;
+            while (!stopped && processed < quantum) {
+                const auto taken = queue->try_drain([this](Message& msg){
+                    stopped = !handle(msg, object(), stats);
+                    return !stopped;
+                }, batch);
+                if (taken == 0) {
+                    break;
+                }
+                processed += taken;
+            }
+
+            if (stopped) {
+                // never goes idle, nothing runs after Stop
+                object().~O();
+                finished.set_value();
+                return;
+            }
+
+            // Going idle without looking at the queue again, which another
+            // worker may be draining by then: a post that came in meanwhile
+            // has left the state notified.
+            auto expected = running;
+            if (processed < quantum && state.compare_exchange_strong(expected, idle, std::memory_order_seq_cst)) {
+                return;
+            }
+            // another turn, behind what else the pool has queued
+            keep_alive = self;
+            pool.schedule(this);
+        }
+
+    private:
+        O& object() noexcept {
+            return *reinterpret_cast<O*>(&storage);
+        }
+
+        std::shared_ptr<Queue> queue;
+        ThreadPool& pool;
+        const std::atomic<std::size_t>& max_batch;
+        Stats& stats;
+        typename std::aligned_storage<sizeof(O), alignof(O)>::type storage;
+        // idle: nothing queued or scheduled; running: a worker is draining;
+        // notified: scheduled, or posted to while running
+        enum State { idle, running, notified };
+        std::atomic<State> state { idle };
+        bool stopped = false;
+        std::shared_ptr<PooledActor> keep_alive;
+        std::promise<void> finished;
     };
 
-    using Queue = ConcurrentQueue<Message>;
+    // Posted by sync: completes the caller's stack state. Destroying it
+    // without running (cancel, shutdown) fails the caller with
+    // CancelledError instead of leaving it blocked.
+    template <class T, class F>
+    struct SyncCall {
+        SyncCall(__impl::State<T>* state, F call)
+                : state { state }
+                , call { std::move(call) }
+        {}
+
+        SyncCall(SyncCall&& other) noexcept
+                : state { std::exchange(other.state, nullptr) }
+                , call { std::move(other.call) }
+        {}
+
+        ~SyncCall() {
+            if (state != nullptr) {
+                state->cancel();
+            }
+        }
+
+        void operator()(O* object) {
+            const auto waiter = std::exchange(state, nullptr);
+            if (object == nullptr) {
+                waiter->expire();
+                return;
+            }
+            __impl::fulfil(*waiter, [this, object](){
+                return call(*object);
+            });
+        }
+
+        __impl::State<T>* state;
+        F call;
+    };
+
+    // Posted by the future-returning async. The call and its result share
+    // one allocation; the message only holds a reference to it.
+    template <class T, class... Params>
+    class FutureCall : public __impl::State<T> {
+    public:
+        template <class... Args>
+        explicit FutureCall(T (O::*f)(Params...), Args&&... args)
+                : f { f }
+                , args { std::forward<Args>(args)... }
+        {}
+
+        void run(O& object) {
+            __impl::fulfil(*this, [this, &object](){
+                return invoke(object, std::index_sequence_for<Params...>{});
+            });
+        }
+
+    private:
+        template <std::size_t... I>
+        T invoke(O& object, std::index_sequence<I...>) {
+            return (object.*f)(std::forward<Params>(std::get<I>(args))...);
+        }
+
+        T (O::*f)(Params...);
+        std::tuple<typename std::decay<Params>::type...> args;
+    };
+
+    template <class Call>
+    struct RunFutureCall {
+        explicit RunFutureCall(__impl::Ref<Call> call) noexcept
+                : call { std::move(call) }
+        {}
+
+        RunFutureCall(RunFutureCall&&) noexcept = default;
+
+        ~RunFutureCall() {
+            if (call) {
+                call->cancel();
+            }
+        }
+
+        void operator()(O* object) {
+            const auto running = std::move(call);
+            if (object == nullptr) {
+                running->expire();
+                return;
+            }
+            running->run(*object);
+        }
+
+        __impl::Ref<Call> call;
+    };
+
+#if defined(__cpp_impl_coroutine)
+    // Returned by call(): the awaiting coroutine suspends until the actor
+    // ran the call, no thread blocks. The completion state and a copy of
+    // the arguments live in the coroutine frame, so nothing is allocated.
+    // Movable until awaited.
+    template <class T, class... Params>
+    class CallAwaiter {
+    public:
+        template <class... Args>
+        CallAwaiter(ActiveObject& actor, const CallOptions& options, T (O::*f)(Params...), Args&&... args)
+                : actor { actor }
+                , options { options }
+                , f { f }
+                , args { std::forward<Args>(args)... }
+        {}
+
+        CallAwaiter(CallAwaiter&& other)
+                : actor { other.actor }
+                , options { other.options }
+                , f { other.f }
+                , args { std::move(other.args) }
+                , resume { other.resume }
+                , executor { other.executor } {
+            assert(!other.state);
+        }
+
+        CallAwaiter& operator=(const CallAwaiter&) = delete;
+
+        // By default the coroutine resumes on the thread that completed
+        // the call, i.e. on the actor; this posts the resumption to
+        // executor (anything with post(callable)) instead.
+        template <class Executor>
+        CallAwaiter resume_on(Executor& executor) && {
+            this->executor = &executor;
+            resume = &post_resume<Executor>;
+            return std::move(*this);
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> awaiting) {
+            state.emplace();
+            // copies, the awaiter is gone once the coroutine resumes
+            state->on_complete([resume = resume, executor = executor, awaiting](){
+                resume(executor, awaiting);
+            });
+            auto call = [this](O& object) -> T {
+                return invoke(object, std::index_sequence_for<Params...>{});
+            };
+            actor.post(Message::action(options, SyncCall<T, decltype(call)>(&*state, std::move(call))));
+        }
+
+        // rethrows what the call threw, CancelledError or TimeoutError
+        T await_resume() {
+            return state->get();
+        }
+
+    private:
+        using Resume = void (*)(void* executor, std::coroutine_handle<> awaiting);
+
+        static void resume_inline(void*, std::coroutine_handle<> awaiting) {
+            awaiting.resume();
+        }
+
+        template <class Executor>
+        static void post_resume(void* executor, std::coroutine_handle<> awaiting) {
+            static_cast<Executor*>(executor)->post([awaiting](){
+                awaiting.resume();
+            });
+        }
+
+        template <std::size_t... I>
+        T invoke(O& object, std::index_sequence<I...>) {
+            return (object.*f)(std::forward<Params>(std::get<I>(args))...);
+        }
+
+        ActiveObject& actor;
+        CallOptions options;
+        T (O::*f)(Params...);
+        std::tuple<typename std::decay<Params>::type...> args;
+        Resume resume = &resume_inline;
+        void* executor = nullptr;
+        std::optional<__impl::State<T>> state;
+    };
+#endif
 
 public:
     template <class... Args>
     ActiveObject(Args&&... args)
             : queue { std::make_shared<Queue>() }
-            , working_thread { &ActiveObject::task_processor<Args...>, queue, std::forward<Args>(args)... }
+            , working_thread { &ActiveObject::task_processor<Args...>, queue, &max_batch, &instrumentation, std::forward<Args>(args)... }
+    {}
+
+    // Shares the pool's workers with other actors; the object is
+    // constructed on the calling thread. The pool must outlive this object.
+    template <class... Args>
+    ActiveObject(executor_arg_t, ThreadPool& pool, Args&&... args)
+            : queue { std::make_shared<Queue>() }
+            , actor { std::make_shared<PooledActor>(queue, pool, max_batch, instrumentation, std::forward<Args>(args)...) }
+            , actor_done { actor->done() }
     {}
 
     ActiveObject(const ActiveObject&) = delete;
     ActiveObject& operator=(const ActiveObject&) = delete;
 
     ~ActiveObject() {
-        queue->push(Message::stop());
-        working_thread.join();
+        // Stop can't be rejected by a full bounded mailbox
+        for (auto stop = Message::stop(); !post(std::move(stop));) {
+            std::this_thread::yield();
+        }
+        if (actor) {
+            actor_done.wait();
+        } else {
+            working_thread.join();
+        }
     }
 
-    template <class T, class ...Args>
-    T sync(T (O::*f)(Args...), Args&&... args) {
-        std::promise<T> promise;
-        queue->push(Message::action([&promise, f, &args...](O& object) {
-            promise.set_value(std::bind(f, &object, std::forward<Args>(args)...)());
-        }));
-        return promise.get_future().get();
+    // Blocks until the call ran; rethrows what it threw, CancelledError if
+    // the message was dropped by cancel(), TimeoutError if it expired.
+    template <class T, class ...Params, class ...Args>
+    T sync(const CallOptions& options, T (O::*f)(Params...), Args&&... args) {
+        __impl::State<T> state;
+        auto call = [f, &args...](O& object) -> T {
+            return (object.*f)(std::forward<Args>(args)...);
+        };
+        post(Message::action(options, SyncCall<T, decltype(call)>(&state, std::move(call))));
+        return state.get();
     }
 
-    template <class ...Args>
-    void sync(void (O::*f)(Args...), Args&&... args) {
-        std::promise<void> promise;
-        queue->push(Message::action([&promise, f, &args...](O& object) {
-            std::bind(f, &object, std::forward<Args>(args)...)();
-            promise.set_value();
-        }));
-        promise.get_future().wait();
+    template <class T, class ...Params, class ...Args>
+    T sync(T (O::*f)(Params...), Args&&... args) {
+        return sync(CallOptions{}, f, std::forward<Args>(args)...);
     }
 
-    template <class C, class T, class ...Args>
-    void async(C callback, T (O::*f)(Args...), Args&&... args) {
-        queue->push(Message::action([this, callback, f, &args...](O& object) {
-            std::function<T()> result_provider = [&object, f, &args...](){
-                return std::bind(f, &object, std::forward<Args>(args)...)();
-            };
-            pass_result(callback, result_provider);
+    // The callback isn't called for a call that is cancelled or expires.
+    template <class C, class T, class ...Params, class ...Args>
+    void async(const CallOptions& options, C callback, T (O::*f)(Params...), Args&&... args) {
+        try_post(options, std::move(callback), f, std::forward<Args>(args)...);
+    }
+
+    template <class C, class T, class ...Params, class ...Args,
+              class = typename std::enable_if<!std::is_same<typename std::decay<C>::type, CallOptions>::value>::type>
+    void async(C callback, T (O::*f)(Params...), Args&&... args) {
+        try_post(CallOptions{}, std::move(callback), f, std::forward<Args>(args)...);
+    }
+
+    // Like async, but reports whether the mailbox took the call: false
+    // only for a full bounded mailbox with Overflow::Fail.
+    template <class C, class T, class ...Params, class ...Args>
+    bool try_post(const CallOptions& options, C callback, T (O::*f)(Params...), Args&&... args) {
+        static_assert(sizeof...(Params) == sizeof...(Args), "wrong number of arguments");
+        // the call outlives this frame, so the arguments are stored by value
+        return post(Message::action(options, AsyncCall<C, T, Params...>{
+                std::move(callback), f, std::forward_as_tuple(std::forward<Args>(args)...)
         }));
     }
 
+    template <class C, class T, class ...Params, class ...Args,
+              class = typename std::enable_if<!std::is_same<typename std::decay<C>::type, CallOptions>::value>::type>
+    bool try_post(C callback, T (O::*f)(Params...), Args&&... args) {
+        return try_post(CallOptions{}, std::move(callback), f, std::forward<Args>(args)...);
+    }
+
+    // Returns a future for the call's result instead of taking a callback.
+    // Arguments are stored by value next to the result: one allocation.
+    template <class T, class ...Params, class ...Args>
+    Future<T> async(const CallOptions& options, T (O::*f)(Params...), Args&&... args) {
+        static_assert(sizeof...(Params) == sizeof...(Args), "wrong number of arguments");
+        using Call = FutureCall<T, Params...>;
+        __impl::Ref<Call> call { new Call(f, std::forward<Args>(args)...) };
+        Future<T> future { __impl::Ref<__impl::State<T>>(call) };
+        post(Message::action(options, RunFutureCall<Call>(std::move(call))));
+        return future;
+    }
+
+    template <class T, class ...Params, class ...Args>
+    Future<T> async(T (O::*f)(Params...), Args&&... args) {
+        return async(CallOptions{}, f, std::forward<Args>(args)...);
+    }
+
+#if defined(__cpp_impl_coroutine)
+    // co_await actor.call(&O::f, args...) - the coroutine counterpart of
+    // sync, same results and errors. C++20 only, see coroutine.h for Task.
+    template <class T, class ...Params, class ...Args>
+    CallAwaiter<T, Params...> call(const CallOptions& options, T (O::*f)(Params...), Args&&... args) {
+        static_assert(sizeof...(Params) == sizeof...(Args), "wrong number of arguments");
+        return CallAwaiter<T, Params...>(*this, options, f, std::forward<Args>(args)...);
+    }
+
+    template <class T, class ...Params, class ...Args>
+    CallAwaiter<T, Params...> call(T (O::*f)(Params...), Args&&... args) {
+        return call(CallOptions{}, f, std::forward<Args>(args)...);
+    }
+#endif
+
+    // Drain mode: the worker takes up to n pending messages per queue
+    // access instead of one. Bounded so a burst can't delay Stop forever.
+    void set_max_batch(std::size_t n) {
+        assert(n > 0);
+        max_batch.store(n, std::memory_order_relaxed);
+    }
+
+    // Drops every queued message. Pending sync calls and futures complete
+    // with CancelledError; callbacks given to async are not called.
     void cancel() {
-        queue->clear([](const Message&){
-            // TODO: tell waiters about cancellation
+        queue->clear([this](const Message& msg){
+            // the message's destructor fails its waiters
+            if (msg.type == Message::Type::Action) {
+                instrumentation.on_dropped();
+            }
         });
     }
 
+    // The instrumentation, e.g. stats().snapshot() with ActorStats. Counts
+    // are approximate while calls are in flight; messages evicted by
+    // Overflow::DropOldest are not seen and stay in the queue depth.
+    const Stats& stats() const noexcept {
+        return instrumentation;
+    }
+
 private:
-    template<class R, class P>
-    void pass_result(R receiver, P result_provider) {
-        receiver(result_provider());
+    // A message the queue rejects (Overflow::Fail) is destroyed here,
+    // which fails its waiters with CancelledError.
+    bool post(Message&& msg) {
+        const bool action = msg.type == Message::Type::Action;
+        if (action) {
+            instrumentation.on_enqueue(msg);
+        }
+        if (!queue->push(std::move(msg))) {
+            if (action) {
+                instrumentation.on_dropped();
+            }
+            return false;
+        }
+        if (actor) {
+            actor->notify();
+        }
+        return true;
     }
 
-    template<class R>
-    void pass_result(R receiver, std::function<void()>) {
-        receiver();
+    // returns false once the object has to stop
+    static bool handle(Message& msg, O& obj, Stats& stats) {
+        switch (msg.type) {
+            case Message::Type::Action: {
+                const auto started = stats.on_dequeue(msg);
+                if (msg.expired()) {
+                    msg.task(nullptr);
+                    stats.on_expired();
+                } else {
+                    msg.task(&obj);
+                    stats.on_executed(started);
+                }
+                return true;
+            }
+            case Message::Type::Stop: {
+                return false;
+            }
+            default: {
+                assert(false && "Unknown message type");
+                return false;
+            }
+        }
     }
 
     template <class... Args>
-    static void task_processor(std::shared_ptr<Queue> queue, Args&&... args) {
+    static void task_processor(std::shared_ptr<Queue> queue,
+                               const std::atomic<std::size_t>* max_batch,
+                               Stats* stats,
+                               Args&&... args) {
 
         // need to provide user-defined creating function
         O obj{ std::forward<Args>(args)... };
 
         bool need_to_stop = false;
         while (!need_to_stop) {
-            queue->wait([&need_to_stop, &obj](Message msg){
-                switch (msg.type) {
-                    case Message::Type::Action: {
-                        msg.task(obj);
-                        break;
-                    }
-                    case Message::Type::Stop: {
-                        need_to_stop = true;
-                        break;
-                    }
-                    default: {
-                        assert(false && "Unknown message type");
-                        need_to_stop = true;
-                        break;
-                    }
-                }
-            });
+            queue->drain([&need_to_stop, &obj, stats](Message& msg){
+                need_to_stop = !handle(msg, obj, *stats);
+                return !need_to_stop;
+            }, max_batch->load(std::memory_order_relaxed));
         }
     }
 
 private:
     std::shared_ptr<Queue> queue;
+    std::atomic<std::size_t> max_batch { 1 };
+    Stats instrumentation;
     std::thread working_thread;
+    std::shared_ptr<PooledActor> actor;
+    std::future<void> actor_done;
 };
 
+template <class O, template <class> class QueuePolicy, class Stats>
+constexpr std::size_t ActiveObject<O, QueuePolicy, Stats>::PooledActor::quantum;
+
 } // namespace utils
 
 
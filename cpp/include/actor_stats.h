@@ -0,0 +1,196 @@
+#ifndef CPP_UTILS_ACTOR_STATS_H
+#define CPP_UTILS_ACTOR_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace utils {
+
+struct HistogramSnapshot {
+    // non-empty buckets as (lowest value in bucket, count), ascending
+    std::vector<std::pair<uint64_t, uint64_t>> buckets;
+    uint64_t count = 0;
+
+    // Smallest bucket bound at or below which a `fraction` of the samples
+    // lie, e.g. percentile(0.99). 0 for an empty histogram.
+    uint64_t percentile(double fraction) const {
+        const auto rank = static_cast<uint64_t>(fraction * count);
+        uint64_t seen = 0;
+        for (const auto& bucket : buckets) {
+            seen += bucket.second;
+            if (seen > rank || seen == count) {
+                return bucket.first;
+            }
+        }
+        return 0;
+    }
+};
+
+// Log-linear (HDR-style) histogram of non-negative integers: each power
+// of two is split into 16 buckets, so bounds are within ~6% of the value.
+// record() is a single relaxed atomic increment.
+class LatencyHistogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 4;
+    static constexpr uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+    // values from 2^48 on share the last bucket
+    static constexpr unsigned max_magnitude = 48;
+    static constexpr std::size_t bucket_count = (max_magnitude - sub_bucket_bits + 1) * sub_buckets;
+
+    LatencyHistogram() noexcept {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t value) noexcept {
+        counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot snapshot;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            const auto count = counts[i].load(std::memory_order_relaxed);
+            if (count != 0) {
+                snapshot.buckets.emplace_back(lower_bound(i), count);
+                snapshot.count += count;
+            }
+        }
+        return snapshot;
+    }
+
+    static std::size_t index(uint64_t value) noexcept {
+        if (value < sub_buckets) {
+            return static_cast<std::size_t>(value);
+        }
+        const auto top = uint64_t(1) << max_magnitude;
+        if (value >= top) {
+            return bucket_count - 1;
+        }
+        const unsigned msb = 63 - __builtin_clzll(value);
+        const auto shift = msb - sub_bucket_bits;
+        return static_cast<std::size_t>((shift + 1) * sub_buckets + ((value >> shift) - sub_buckets));
+    }
+
+    static uint64_t lower_bound(std::size_t index) noexcept {
+        if (index < sub_buckets) {
+            return index;
+        }
+        const auto shift = index / sub_buckets - 1;
+        return (sub_buckets + index % sub_buckets) << shift;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> counts;
+};
+
+// Default ActiveObject instrumentation: everything is empty and inlines
+// away, messages carry no timestamp.
+struct NoStats {
+    struct Stamp {};
+    struct Started {};
+
+    void on_enqueue(Stamp&) noexcept {}
+    void on_dropped() noexcept {}
+    Started on_dequeue(const Stamp&) noexcept { return {}; }
+    void on_executed(const Started&) noexcept {}
+    void on_expired() noexcept {}
+};
+
+struct ActorStatsSnapshot {
+    uint64_t enqueued = 0;
+    uint64_t executed = 0;
+    // past their deadline when the worker got to them, so not run
+    uint64_t expired = 0;
+    uint64_t dropped = 0;
+    int64_t queue_depth = 0;
+    int64_t max_queue_depth = 0;
+    // nanoseconds between post and the worker picking the message up
+    HistogramSnapshot queue_wait;
+    // nanoseconds spent in the call itself, for the calls that ran
+    HistogramSnapshot execution;
+};
+
+// ActiveObject<O, Queue, ActorStats>: timestamps every message and keeps
+// counters and latency histograms that any thread can snapshot.
+class ActorStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stamp {
+        Clock::time_point enqueued;
+    };
+
+    struct Started {
+        Clock::time_point at;
+    };
+
+    void on_enqueue(Stamp& stamp) noexcept {
+        stamp.enqueued = Clock::now();
+        enqueued.fetch_add(1, std::memory_order_relaxed);
+        const auto depth = queue_depth.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto high = max_queue_depth.load(std::memory_order_relaxed);
+        while (depth > high && !max_queue_depth.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {}
+    }
+
+    // rejected by a full mailbox or removed by cancel()
+    void on_dropped() noexcept {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        queue_depth.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    Started on_dequeue(const Stamp& stamp) noexcept {
+        const auto now = Clock::now();
+        queue_depth.fetch_sub(1, std::memory_order_relaxed);
+        queue_wait.record(nanoseconds(now - stamp.enqueued));
+        return Started { now };
+    }
+
+    void on_executed(const Started& started) noexcept {
+        executed.fetch_add(1, std::memory_order_relaxed);
+        execution.record(nanoseconds(Clock::now() - started.at));
+    }
+
+    void on_expired() noexcept {
+        expired.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ActorStatsSnapshot snapshot() const {
+        ActorStatsSnapshot snapshot;
+        snapshot.enqueued = enqueued.load(std::memory_order_relaxed);
+        snapshot.executed = executed.load(std::memory_order_relaxed);
+        snapshot.expired = expired.load(std::memory_order_relaxed);
+        snapshot.dropped = dropped.load(std::memory_order_relaxed);
+        snapshot.queue_depth = queue_depth.load(std::memory_order_relaxed);
+        snapshot.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+        snapshot.queue_wait = queue_wait.snapshot();
+        snapshot.execution = execution.snapshot();
+        return snapshot;
+    }
+
+private:
+    static uint64_t nanoseconds(Clock::duration duration) noexcept {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    }
+
+    std::atomic<uint64_t> enqueued { 0 };
+    std::atomic<uint64_t> executed { 0 };
+    std::atomic<uint64_t> expired { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+    std::atomic<int64_t> queue_depth { 0 };
+    std::atomic<int64_t> max_queue_depth { 0 };
+    LatencyHistogram queue_wait;
+    LatencyHistogram execution;
+};
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_ACTOR_STATS_H
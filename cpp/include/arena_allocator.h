@@ -0,0 +1,72 @@
+#ifndef CPP_UTILS_ARENA_ALLOCATOR_H
+#define CPP_UTILS_ARENA_ALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+#include "merge_allocator.h"
+
+
+// Standard allocator over a MergeAllocator, for containers living on an
+// arena:
+//
+//     std::vector<int, ArenaAllocator<int>> numbers { ArenaAllocator<int>(allocator) };
+//
+// Copies share the MergeAllocator and compare equal if it is the same one.
+// Throws std::bad_alloc when the arena is full, or can't align as asked.
+template <class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(MergeAllocator& allocator) noexcept
+        : allocator { &allocator } {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : allocator { other.allocator } {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        const auto ptr = allocator->allocateAligned(bytes(n), alignof(T));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return reinterpret_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        allocator->deallocate(reinterpret_cast<char*>(ptr), bytes(n));
+    }
+
+    MergeAllocator& arena() const noexcept {
+        return *allocator;
+    }
+
+private:
+    template <class U>
+    friend class ArenaAllocator;
+
+    // the standard allows zero sized requests, MergeAllocator doesn't
+    static size_t bytes(size_t n) noexcept {
+        return n == 0 ? 1 : n * sizeof(T);
+    }
+
+    MergeAllocator* allocator;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+    return &lhs.arena() == &rhs.arena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+
+#endif //CPP_UTILS_ARENA_ALLOCATOR_H
@@ -0,0 +1,820 @@
+#ifndef CPP_UTILS_CONCURRENT_QUEUE_H
+#define CPP_UTILS_CONCURRENT_QUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+
+namespace utils {
+
+namespace __impl {
+
+// FIFO over a power-of-two circular buffer. Unlike std::queue it keeps its
+// storage when drained, so a warmed-up queue does not allocate.
+template <class T>
+class RingQueue {
+public:
+    RingQueue() noexcept = default;
+
+    RingQueue(RingQueue&& other) noexcept {
+        swap(other);
+    }
+
+    RingQueue& operator=(RingQueue&& other) noexcept {
+        RingQueue tmp { std::move(other) };
+        swap(tmp);
+        return *this;
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    ~RingQueue() {
+        while (!empty()) {
+            pop();
+        }
+        ::operator delete(buffer);
+    }
+
+    void swap(RingQueue& other) noexcept {
+        std::swap(buffer, other.buffer);
+        std::swap(capacity_, other.capacity_);
+        std::swap(first, other.first);
+        std::swap(count, other.count);
+    }
+
+    void push(T&& elem) {
+        if (count == capacity_) {
+            grow();
+        }
+        new (slot(first + count)) T(std::move(elem));
+        ++count;
+    }
+
+    T& front() noexcept {
+        assert(!empty());
+        return *slot(first);
+    }
+
+    void pop() noexcept {
+        assert(!empty());
+        slot(first)->~T();
+        first = (first + 1) & (capacity_ - 1);
+        --count;
+    }
+
+    void reserve(std::size_t n) {
+        if (capacity_ < n) {
+            auto new_capacity = capacity_ == 0 ? std::size_t(16) : capacity_;
+            while (new_capacity < n) {
+                new_capacity *= 2;
+            }
+            reallocate(new_capacity);
+        }
+    }
+
+    bool empty() const noexcept { return count == 0; }
+    std::size_t size() const noexcept { return count; }
+    std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+    T* slot(std::size_t index) const noexcept {
+        return buffer + (index & (capacity_ - 1));
+    }
+
+    void grow() {
+        reallocate(capacity_ == 0 ? std::size_t(16) : capacity_ * 2);
+    }
+
+    void reallocate(std::size_t new_capacity) {
+        const auto new_buffer = static_cast<T*>(::operator new(new_capacity * sizeof(T)));
+        for (std::size_t i = 0; i < count; ++i) {
+            new (new_buffer + i) T(std::move(*slot(first + i)));
+            slot(first + i)->~T();
+        }
+        ::operator delete(buffer);
+        buffer = new_buffer;
+        capacity_ = new_capacity;
+        first = 0;
+    }
+
+    T* buffer = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t first = 0;
+    std::size_t count = 0;
+};
+
+template <class T>
+void swap(RingQueue<T>& lhs, RingQueue<T>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+// Spin with growing pauses, then yield; spin() turns false when it's time
+// to park.
+class Backoff {
+public:
+    bool spin() noexcept {
+        if (step < pausing_steps) {
+            for (unsigned i = 0; i < (1u << step); ++i) {
+                pause();
+            }
+        } else if (step < pausing_steps + yielding_steps) {
+            std::this_thread::yield();
+        } else {
+            return false;
+        }
+        ++step;
+        return true;
+    }
+
+private:
+    static void pause() noexcept {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_ia32_pause();
+#endif
+    }
+
+    static constexpr unsigned pausing_steps = 7;
+    static constexpr unsigned yielding_steps = 4;
+
+    unsigned step = 0;
+};
+
+} // namespace __impl
+
+template <class T>
+class ConcurrentQueue
+        : public std::enable_shared_from_this<ConcurrentQueue<T>> {
+public:
+    // Unbounded, always accepts the element.
+    bool push(T&& elem) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            queue.push(std::move(elem));
+        }
+        condition_variable.notify_one();
+        return true;
+    }
+
+    template <class CALLBACK>
+    void clear(CALLBACK callback) {
+        __impl::RingQueue<T> old_queue;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            old_queue.swap(queue);
+        }
+
+        while (!old_queue.empty()) {
+            auto elem = std::move(old_queue.front());
+            old_queue.pop();
+
+            callback(elem);
+        }
+    }
+
+    template <class CALLBACK>
+    void wait(CALLBACK callback) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition_variable.wait(lock, [this](){
+            return !queue.empty();
+        });
+
+        auto elem = std::move(queue.front());
+        queue.pop();
+        lock.unlock();
+
+        callback(elem);
+    }
+
+    // Takes up to max_batch elements under a single lock and hands them to
+    // the callback one by one; the callback returns false to stop early.
+    template <class CALLBACK>
+    void drain(CALLBACK callback, std::size_t max_batch) {
+        assert(max_batch > 0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition_variable.wait(lock, [this](){
+                return !queue.empty();
+            });
+            take_batch(max_batch);
+        }
+        run_batch(callback);
+    }
+
+    // Non-blocking drain, returns how many elements were taken.
+    template <class CALLBACK>
+    std::size_t try_drain(CALLBACK callback, std::size_t max_batch) {
+        assert(max_batch > 0);
+        std::size_t taken = 0;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (queue.empty()) {
+                return 0;
+            }
+            taken = take_batch(max_batch);
+        }
+        run_batch(callback);
+        return taken;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return queue.empty();
+    }
+
+private:
+    std::size_t take_batch(std::size_t max_batch) {
+        const auto taken = std::min(queue.size(), max_batch);
+        if (taken == queue.size()) {
+            batch.swap(queue);
+            // producers get the buffer the consumer had; keep it as big
+            // as the other one so bursts don't reallocate
+            queue.reserve(batch.capacity());
+        } else {
+            for (std::size_t i = 0; i < taken; ++i) {
+                batch.push(std::move(queue.front()));
+                queue.pop();
+            }
+        }
+        return taken;
+    }
+
+    template <class CALLBACK>
+    void run_batch(CALLBACK& callback) {
+        while (!batch.empty()) {
+            auto elem = std::move(batch.front());
+            batch.pop();
+
+            if (!callback(elem)) {
+                break;
+            }
+        }
+    }
+
+    __impl::RingQueue<T> queue;
+    // owned by the consumer, only touched in drain
+    __impl::RingQueue<T> batch;
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+};
+
+
+// Parking primitive: notifiers only touch the mutex when somebody is
+// actually asleep.
+class EventCount {
+public:
+    using Key = uint32_t;
+
+    Key prepare_wait() noexcept {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait() noexcept {
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void wait(Key key) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition_variable.wait(lock, [this, key](){
+            return epoch.load(std::memory_order_relaxed) != key;
+        });
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void notify() {
+        if (bump()) {
+            condition_variable.notify_all();
+        }
+    }
+
+    void notify_one() {
+        if (bump()) {
+            condition_variable.notify_one();
+        }
+    }
+
+private:
+    bool bump() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(mutex);
+        epoch.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::atomic<Key> epoch { 0 };
+    std::atomic<uint32_t> waiters { 0 };
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+};
+
+
+// Lock-free multi-producer/single-consumer queue (intrusive Vyukov list).
+// `push` and `clear` may be called from any thread, `wait` only from the
+// consumer. `clear` is asynchronous: elements pushed before it are handed
+// to the callback by the consumer on its next `wait`.
+template <class T>
+class MpscQueue
+        : public std::enable_shared_from_this<MpscQueue<T>> {
+public:
+    MpscQueue() noexcept
+            : head { &stub }
+            , tail { &stub }
+    {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue() {
+        while (auto node = pop()) {
+            delete node;
+        }
+    }
+
+    bool push(T&& elem) {
+        const auto node = new Node { generation.load(std::memory_order_relaxed), std::move(elem) };
+        link(node);
+        event.notify();
+        return true;
+    }
+
+    template <class CALLBACK>
+    void clear(CALLBACK callback) {
+        {
+            std::lock_guard<std::mutex> guard(clear_mutex);
+            pending_clear = callback;
+        }
+        generation.fetch_add(1, std::memory_order_relaxed);
+        event.notify();
+    }
+
+    template <class CALLBACK>
+    void wait(CALLBACK callback) {
+        drain([&callback](T& elem){
+            callback(elem);
+            return false;
+        }, 1);
+    }
+
+    // Blocks for the first element, then takes whatever else is already
+    // linked, up to max_batch in total.
+    template <class CALLBACK>
+    void drain(CALLBACK callback, std::size_t max_batch) {
+        drain_from(pop_blocking(), callback, max_batch, true);
+    }
+
+    template <class CALLBACK>
+    std::size_t try_drain(CALLBACK callback, std::size_t max_batch) {
+        return drain_from(pop(), callback, max_batch, false);
+    }
+
+    // Consumer only. A push that is half way through reports as empty; it
+    // is ordered after this call and the producer notices that itself.
+    bool empty() const noexcept {
+        return tail == &stub && head.load(std::memory_order_seq_cst) == &stub;
+    }
+
+private:
+    struct Link {
+        std::atomic<Link*> next { nullptr };
+    };
+
+    struct Node : Link {
+        Node(uint64_t generation, T&& value)
+                : generation { generation }
+                , value { std::move(value) }
+        {}
+
+        uint64_t generation;
+        T value;
+    };
+
+    void link(Link* node) noexcept {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        const auto prev = head.exchange(node, std::memory_order_seq_cst);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Returns nullptr when the queue is empty or a producer is half way
+    // through `link`; in the latter case the producer will notify us.
+    Node* pop() noexcept {
+        auto current = tail;
+        auto next = current->next.load(std::memory_order_acquire);
+        if (current == &stub) {
+            if (next == nullptr) {
+                return nullptr;
+            }
+            tail = current = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return static_cast<Node*>(current);
+        }
+        if (current != head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        link(&stub);
+        next = current->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return static_cast<Node*>(current);
+        }
+        return nullptr;
+    }
+
+    Node* pop_blocking() {
+        static constexpr int spins_before_parking = 64;
+        for (;;) {
+            for (int i = 0; i < spins_before_parking; ++i) {
+                if (auto node = pop()) {
+                    return node;
+                }
+            }
+            const auto key = event.prepare_wait();
+            if (auto node = pop()) {
+                event.cancel_wait();
+                return node;
+            }
+            event.wait(key);
+        }
+    }
+
+    template <class CALLBACK>
+    std::size_t drain_from(Node* node, CALLBACK& callback, std::size_t max_batch, bool blocking) {
+        assert(max_batch > 0);
+        std::size_t taken = 0;
+        while (node != nullptr) {
+            std::unique_ptr<Node> holder { node };
+            if (node->generation != generation.load(std::memory_order_relaxed)) {
+                discarded(node->value);
+            } else {
+                ++taken;
+                if (!callback(node->value)) {
+                    break;
+                }
+            }
+            node = taken == 0 && blocking ? pop_blocking() : taken < max_batch ? pop() : nullptr;
+        }
+        return taken;
+    }
+
+    void discarded(T& value) {
+        std::lock_guard<std::mutex> guard(clear_mutex);
+        if (pending_clear) {
+            pending_clear(value);
+        }
+    }
+
+    std::atomic<Link*> head;
+    Link* tail;
+    Link stub;
+    std::atomic<uint64_t> generation { 0 };
+    EventCount event;
+    std::mutex clear_mutex;
+    std::function<void(T&)> pending_clear;
+};
+
+
+// What a BoundedQueue does with a push that finds it full.
+enum class Overflow {
+    Block,      // wait for space: spin, then park
+    Fail,       // reject the element, push returns false
+    DropOldest  // destroy the oldest queued element to make room
+};
+
+// Fixed-capacity queue over a preallocated ring (Vyukov's bounded MPMC
+// algorithm), so it never allocates after construction. Capacity must be a
+// power of two. Any thread may push, pop or clear.
+template <class T, std::size_t Capacity, Overflow Policy = Overflow::Block>
+class BoundedQueue
+        : public std::enable_shared_from_this<BoundedQueue<T, Capacity, Policy>> {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    static constexpr std::size_t capacity = Capacity;
+    static constexpr Overflow overflow = Policy;
+
+    BoundedQueue()
+            : cells { new Cell[Capacity] } {
+        for (std::size_t i = 0; i < Capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    ~BoundedQueue() {
+        T elem;
+        while (try_pop(elem)) {}
+    }
+
+    // On false (Overflow::Fail and full) elem is left untouched.
+    bool push(T&& elem) {
+        return push(elem, std::integral_constant<Overflow, Policy>{});
+    }
+
+    template <class CALLBACK>
+    void clear(CALLBACK callback) {
+        T elem;
+        while (try_pop(elem)) {
+            callback(elem);
+        }
+    }
+
+    template <class CALLBACK>
+    void wait(CALLBACK callback) {
+        drain([&callback](T& elem){
+            callback(elem);
+            return false;
+        }, 1);
+    }
+
+    template <class CALLBACK>
+    void drain(CALLBACK callback, std::size_t max_batch) {
+        assert(max_batch > 0);
+        T elem;
+        pop_blocking(elem);
+        if (!callback(elem)) {
+            return;
+        }
+        try_drain(callback, max_batch - 1);
+    }
+
+    template <class CALLBACK>
+    std::size_t try_drain(CALLBACK callback, std::size_t max_batch) {
+        std::size_t taken = 0;
+        T elem;
+        while (taken < max_batch && try_pop(elem)) {
+            ++taken;
+            if (!callback(elem)) {
+                break;
+            }
+        }
+        return taken;
+    }
+
+    // Counts claimed slots, a push in progress already makes it non-empty.
+    bool empty() const noexcept {
+        return enqueue_pos.load(std::memory_order_seq_cst) == dequeue_pos.load(std::memory_order_seq_cst);
+    }
+
+    std::size_t size() const noexcept {
+        const auto head = dequeue_pos.load(std::memory_order_relaxed);
+        const auto tail = enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? std::min(tail - head, Capacity) : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T& value() noexcept {
+            return *reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    bool push(T& elem, std::integral_constant<Overflow, Overflow::Fail>) {
+        return try_push(elem);
+    }
+
+    bool push(T& elem, std::integral_constant<Overflow, Overflow::DropOldest>) {
+        while (!try_push(elem)) {
+            T oldest;
+            try_pop(oldest);
+        }
+        return true;
+    }
+
+    bool push(T& elem, std::integral_constant<Overflow, Overflow::Block>) {
+        for (__impl::Backoff backoff; !try_push(elem);) {
+            if (backoff.spin()) {
+                continue;
+            }
+            const auto key = not_full.prepare_wait();
+            if (try_push(elem)) {
+                not_full.cancel_wait();
+                break;
+            }
+            not_full.wait(key);
+        }
+        return true;
+    }
+
+    bool try_push(T& elem) {
+        auto pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells[pos & (Capacity - 1)];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    new (&cell.storage) T(std::move(elem));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    not_empty.notify();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& elem) {
+        auto pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells[pos & (Capacity - 1)];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    elem = std::move(cell.value());
+                    cell.value().~T();
+                    cell.sequence.store(pos + Capacity, std::memory_order_release);
+                    not_full.notify_one();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void pop_blocking(T& elem) {
+        for (__impl::Backoff backoff; !try_pop(elem);) {
+            if (backoff.spin()) {
+                continue;
+            }
+            const auto key = not_empty.prepare_wait();
+            if (try_pop(elem)) {
+                not_empty.cancel_wait();
+                return;
+            }
+            not_empty.wait(key);
+        }
+    }
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::size_t> enqueue_pos { 0 };
+    alignas(64) std::atomic<std::size_t> dequeue_pos { 0 };
+    EventCount not_empty;
+    EventCount not_full;
+};
+
+template <class T, std::size_t Capacity, Overflow Policy>
+constexpr std::size_t BoundedQueue<T, Capacity, Policy>::capacity;
+
+template <class T, std::size_t Capacity, Overflow Policy>
+constexpr Overflow BoundedQueue<T, Capacity, Policy>::overflow;
+
+// Adapts BoundedQueue to ActiveObject's QueuePolicy parameter:
+// ActiveObject<O, Bounded<1024, Overflow::DropOldest>::type>
+template <std::size_t Capacity, Overflow Policy = Overflow::Block>
+struct Bounded {
+    template <class T>
+    using type = BoundedQueue<T, Capacity, Policy>;
+};
+
+
+// Mutex-based queue with Lanes FIFO lanes; elements expose a `priority`
+// member and the highest non-empty lane is always served first. Priorities
+// past the last lane go to the last one.
+template <class T, std::size_t Lanes>
+class PriorityQueue
+        : public std::enable_shared_from_this<PriorityQueue<T, Lanes>> {
+    static_assert(Lanes > 0, "need at least one lane");
+public:
+    bool push(T&& elem) {
+        const auto lane = std::min<std::size_t>(elem.priority, Lanes - 1);
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            lanes[lane].push(std::move(elem));
+            ++count;
+        }
+        condition_variable.notify_one();
+        return true;
+    }
+
+    template <class CALLBACK>
+    void clear(CALLBACK callback) {
+        std::array<__impl::RingQueue<T>, Lanes> old_lanes;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            std::swap(old_lanes, lanes);
+            count = 0;
+        }
+        for (auto lane = Lanes; lane-- > 0;) {
+            while (!old_lanes[lane].empty()) {
+                auto elem = std::move(old_lanes[lane].front());
+                old_lanes[lane].pop();
+
+                callback(elem);
+            }
+        }
+    }
+
+    template <class CALLBACK>
+    void wait(CALLBACK callback) {
+        drain([&callback](T& elem){
+            callback(elem);
+            return false;
+        }, 1);
+    }
+
+    // Takes up to max_batch elements, highest lanes first, under one lock.
+    // A more urgent element that arrives meanwhile waits for the batch.
+    template <class CALLBACK>
+    void drain(CALLBACK callback, std::size_t max_batch) {
+        assert(max_batch > 0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition_variable.wait(lock, [this](){
+                return count > 0;
+            });
+            take_batch(max_batch);
+        }
+        run_batch(callback);
+    }
+
+    template <class CALLBACK>
+    std::size_t try_drain(CALLBACK callback, std::size_t max_batch) {
+        assert(max_batch > 0);
+        std::size_t taken = 0;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            taken = take_batch(max_batch);
+        }
+        run_batch(callback);
+        return taken;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return count == 0;
+    }
+
+private:
+    std::size_t take_batch(std::size_t max_batch) {
+        std::size_t taken = 0;
+        for (auto lane = Lanes; lane-- > 0 && taken < max_batch;) {
+            auto& queue = lanes[lane];
+            for (; taken < max_batch && !queue.empty(); ++taken) {
+                batch.push(std::move(queue.front()));
+                queue.pop();
+            }
+        }
+        count -= taken;
+        return taken;
+    }
+
+    template <class CALLBACK>
+    void run_batch(CALLBACK& callback) {
+        while (!batch.empty()) {
+            auto elem = std::move(batch.front());
+            batch.pop();
+
+            if (!callback(elem)) {
+                break;
+            }
+        }
+    }
+
+    std::array<__impl::RingQueue<T>, Lanes> lanes;
+    std::size_t count = 0;
+    // owned by the consumer, only touched in drain
+    __impl::RingQueue<T> batch;
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+};
+
+// Adapts PriorityQueue to ActiveObject's QueuePolicy parameter:
+// ActiveObject<O, Prioritized<4>::type>
+template <std::size_t Lanes>
+struct Prioritized {
+    template <class T>
+    using type = PriorityQueue<T, Lanes>;
+};
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_CONCURRENT_QUEUE_H
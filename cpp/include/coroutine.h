@@ -0,0 +1,360 @@
+#ifndef CPP_UTILS_COROUTINE_H
+#define CPP_UTILS_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine.h needs C++20 coroutines"
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "concurrent_queue.h"
+#include "future.h"
+#include "small_function.h"
+
+
+// Coroutine layer over the actors: ActiveObject::call is awaitable (C++20
+// only), Task<T> is the coroutine type to write conversations in, and
+// Scheduler runs them on a few threads.
+//
+//     utils::Task<int> total(utils::ActiveObject<Account>& account) {
+//         co_await account.call(&Account::deposit, 10);
+//         co_return co_await account.call(&Account::balance);
+//     }
+namespace utils {
+
+template <class T = void>
+class Task;
+
+namespace __impl {
+
+class TaskPromiseBase {
+public:
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    // hands control straight to whoever awaited the task
+    struct FinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+            const auto next = self.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        error = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation;
+
+protected:
+    void rethrow_if_failed() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    std::exception_ptr error;
+};
+
+template <class T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object() noexcept;
+
+    template <class U>
+    void return_value(U&& value) {
+        slot.set(std::forward<U>(value));
+    }
+
+    T take() {
+        rethrow_if_failed();
+        return slot.take();
+    }
+
+private:
+    Slot<T> slot;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void take() {
+        rethrow_if_failed();
+    }
+};
+
+// Fire-and-forget coroutine: starts right away, frees itself at the end.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace __impl
+
+
+// Lazy coroutine: runs when awaited, and resumes its awaiter when done,
+// passing on the value or the exception. Awaited once.
+template <class T>
+class Task {
+public:
+    using promise_type = __impl::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() noexcept = default;
+
+    explicit Task(Handle handle) noexcept
+            : handle { handle } {}
+
+    Task(Task&& other) noexcept
+            : handle { std::exchange(other.handle, nullptr) } {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    bool valid() const noexcept {
+        return static_cast<bool>(handle);
+    }
+
+    auto operator co_await() noexcept {
+        struct Awaiter {
+            bool await_ready() const noexcept {
+                return handle.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() {
+                return handle.promise().take();
+            }
+
+            Handle handle;
+        };
+        assert(valid());
+        return Awaiter { handle };
+    }
+
+private:
+    void reset() noexcept {
+        if (handle) {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+
+    Handle handle;
+};
+
+template <class T>
+Task<T> __impl::TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+inline Task<void> __impl::TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+
+// Coroutine executor: a few threads, each draining its own
+// ConcurrentQueue. Also usable wherever an executor with post(callable) is
+// expected, e.g. ActiveObject::call(...).resume_on(scheduler).
+class Scheduler {
+public:
+    explicit Scheduler(std::size_t threads = 1)
+            : lanes(threads) {
+        assert(threads > 0);
+        for (auto& lane : lanes) {
+            lane.reset(new Lane);
+        }
+        for (auto& lane : lanes) {
+            lane->thread = std::thread(&Scheduler::work, this, lane.get());
+        }
+    }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Runs what is already queued, and what that posts in turn, a coroutine
+    // hopping between the threads say, then joins. Nothing else may be
+    // posted after destruction starts.
+    ~Scheduler() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping.store(true);
+            drained.wait(lock, [this](){ return pending.load() == 0; });
+        }
+        for (auto& lane : lanes) {
+            lane->queue.push(nullptr);
+        }
+        for (auto& lane : lanes) {
+            lane->thread.join();
+            // a producer may still be inside push, notifying
+            while (lane->pushing.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Round-robins over the threads; a resumption fits inline and doesn't
+    // allocate.
+    template <class F>
+    void post(F&& f) {
+        auto& lane = *lanes[next.fetch_add(1, std::memory_order_relaxed) % lanes.size()];
+        pending.fetch_add(1);
+        lane.pushing.fetch_add(1, std::memory_order_relaxed);
+        lane.queue.push(SmallFunction<void()>(std::forward<F>(f)));
+        lane.pushing.fetch_sub(1, std::memory_order_release);
+    }
+
+    // co_await scheduler.schedule() continues on one of the threads.
+    auto schedule() noexcept {
+        struct Awaiter {
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> awaiting) {
+                scheduler.post([awaiting](){
+                    awaiting.resume();
+                });
+            }
+
+            void await_resume() noexcept {}
+
+            Scheduler& scheduler;
+        };
+        return Awaiter { *this };
+    }
+
+    // Starts the task on the scheduler without waiting for it. An exception
+    // escaping the task terminates, like one escaping a std::thread.
+    void spawn(Task<void> task) {
+        run(*this, std::move(task));
+    }
+
+private:
+    struct Lane {
+        ConcurrentQueue<SmallFunction<void()>> queue;
+        std::atomic<int> pushing { 0 };
+        std::thread thread;
+    };
+
+    static void work(Scheduler* scheduler, Lane* lane) {
+        bool stop = false;
+        while (!stop) {
+            lane->queue.drain([scheduler, &stop](SmallFunction<void()>& f){
+                stop = !f;
+                if (!stop) {
+                    f();
+                    scheduler->done();
+                }
+                return !stop;
+            }, 64);
+        }
+    }
+
+    // What f posted counts already, so pending only gets to 0 once nothing
+    // queued can post any more.
+    void done() {
+        if (pending.fetch_sub(1) == 1 && stopping.load()) {
+            std::lock_guard<std::mutex> guard(mutex);
+            drained.notify_all();
+        }
+    }
+
+    static __impl::Detached run(Scheduler& scheduler, Task<void> task) {
+        co_await scheduler.schedule();
+        co_await task;
+    }
+
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<std::size_t> next { 0 };
+    // posted and not run yet; the lanes get their stop sentinels once it
+    // is 0 with stopping set
+    std::atomic<std::size_t> pending { 0 };
+    std::atomic<bool> stopping { false };
+    std::mutex mutex;
+    std::condition_variable drained;
+};
+
+
+namespace __impl {
+
+template <class T>
+Detached complete(State<T>& state, Task<T> task) {
+    std::exception_ptr error;
+    try {
+        if constexpr (std::is_void<T>::value) {
+            co_await task;
+            state.set_value();
+        } else {
+            state.set_value(co_await task);
+        }
+        co_return;
+    } catch (...) {
+        error = std::current_exception();
+    }
+    state.fail(error);
+}
+
+} // namespace __impl
+
+// Blocks the calling thread until the task is done, for the edge between
+// plain and coroutine code (main, tests). Rethrows what the task threw.
+template <class T>
+T sync_wait(Task<T> task) {
+    __impl::State<T> state;
+    __impl::complete(state, std::move(task));
+    return state.get();
+}
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_COROUTINE_H
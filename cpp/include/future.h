@@ -0,0 +1,393 @@
+#ifndef CPP_UTILS_FUTURE_H
+#define CPP_UTILS_FUTURE_H
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "small_function.h"
+
+
+namespace utils {
+
+// Result of a Future whose operation was dropped before it ran.
+class CancelledError : public std::runtime_error {
+public:
+    CancelledError()
+            : std::runtime_error("operation cancelled") {}
+};
+
+// Result of a Future whose operation missed its deadline.
+class TimeoutError : public std::runtime_error {
+public:
+    TimeoutError()
+            : std::runtime_error("deadline expired") {}
+};
+
+template <class T>
+class Future;
+
+namespace __impl {
+
+template <class T>
+class Slot {
+public:
+    Slot() noexcept = default;
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+
+    ~Slot() {
+        if (has_value) {
+            reinterpret_cast<T*>(&storage)->~T();
+        }
+    }
+
+    template <class U>
+    void set(U&& value) {
+        assert(!has_value);
+        new (&storage) T(std::forward<U>(value));
+        has_value = true;
+    }
+
+    T take() {
+        assert(has_value);
+        return std::move(*reinterpret_cast<T*>(&storage));
+    }
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    bool has_value = false;
+};
+
+template <>
+class Slot<void> {
+public:
+    void take() noexcept {}
+};
+
+// Completion shared between the producer of a value and its consumer.
+// Heap states are reference counted, a blocking caller may also keep one
+// on its stack and never touch the counter.
+class StateBase {
+public:
+    StateBase() noexcept = default;
+    StateBase(const StateBase&) = delete;
+    StateBase& operator=(const StateBase&) = delete;
+
+    void retain() noexcept {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return done;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition_variable.wait(lock, [this](){
+            return done;
+        });
+    }
+
+    void fail(std::exception_ptr e) {
+        error = std::move(e);
+        finish();
+    }
+
+    void cancel() {
+        fail(std::make_exception_ptr(CancelledError()));
+    }
+
+    void expire() {
+        fail(std::make_exception_ptr(TimeoutError()));
+    }
+
+    // Runs f once the state completes: right away if it already has,
+    // otherwise on the completing thread.
+    void on_complete(SmallFunction<void()> f) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (!done) {
+                continuation = std::move(f);
+                return;
+            }
+        }
+        f();
+    }
+
+    const std::exception_ptr& failure() const noexcept {
+        return error;
+    }
+
+protected:
+    virtual ~StateBase() = default;
+
+    void finish() {
+        SmallFunction<void()> next;
+        {
+            // notify under the lock: a stack state dies as soon as its
+            // waiter sees `done`
+            std::lock_guard<std::mutex> guard(mutex);
+            assert(!done);
+            done = true;
+            next = std::move(continuation);
+            condition_variable.notify_all();
+        }
+        if (next) {
+            next();
+        }
+    }
+
+private:
+    std::atomic<int> refs { 1 };
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    bool done = false;
+    std::exception_ptr error;
+    SmallFunction<void()> continuation;
+};
+
+template <class T>
+class State : public StateBase {
+public:
+    template <class U>
+    void set_value(U&& value) {
+        slot.set(std::forward<U>(value));
+        finish();
+    }
+
+    T get() {
+        wait();
+        if (failure()) {
+            std::rethrow_exception(failure());
+        }
+        return slot.take();
+    }
+
+    T take() {
+        return slot.take();
+    }
+
+private:
+    Slot<T> slot;
+};
+
+template <>
+class State<void> : public StateBase {
+public:
+    void set_value() {
+        finish();
+    }
+
+    void get() {
+        wait();
+        if (failure()) {
+            std::rethrow_exception(failure());
+        }
+    }
+
+    void take() noexcept {}
+};
+
+// Intrusive owning pointer to a heap state, adopts the initial reference.
+template <class S>
+class Ref {
+public:
+    Ref() noexcept = default;
+
+    explicit Ref(S* state) noexcept
+            : state { state } {}
+
+    template <class D, class = typename std::enable_if<std::is_convertible<D*, S*>::value>::type>
+    Ref(const Ref<D>& other) noexcept
+            : state { other.get() } {
+        if (state != nullptr) {
+            state->retain();
+        }
+    }
+
+    Ref(const Ref& other) noexcept
+            : state { other.state } {
+        if (state != nullptr) {
+            state->retain();
+        }
+    }
+
+    Ref(Ref&& other) noexcept
+            : state { std::exchange(other.state, nullptr) } {}
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(state, other.state);
+        return *this;
+    }
+
+    ~Ref() {
+        if (state != nullptr) {
+            state->release();
+        }
+    }
+
+    S* get() const noexcept { return state; }
+    S* operator->() const noexcept { return state; }
+    S& operator*() const noexcept { return *state; }
+    explicit operator bool() const noexcept { return state != nullptr; }
+
+private:
+    S* state = nullptr;
+};
+
+// Completes the state with what f returns, or with what it throws.
+template <class T, class F>
+void fulfil(State<T>& state, F&& f, std::false_type /* void */) {
+    try {
+        state.set_value(f());
+    } catch (...) {
+        state.fail(std::current_exception());
+    }
+}
+
+template <class F>
+void fulfil(State<void>& state, F&& f, std::true_type /* void */) {
+    try {
+        f();
+    } catch (...) {
+        state.fail(std::current_exception());
+        return;
+    }
+    state.set_value();
+}
+
+template <class T, class F>
+void fulfil(State<T>& state, F&& f) {
+    fulfil(state, std::forward<F>(f), std::is_void<T>{});
+}
+
+template <class F, class T>
+struct ContinuationResult {
+    using type = decltype(std::declval<F&>()(std::declval<T>()));
+};
+
+template <class F>
+struct ContinuationResult<F, void> {
+    using type = decltype(std::declval<F&>()());
+};
+
+template <class F, class T>
+using continuation_result_t = typename ContinuationResult<F, T>::type;
+
+template <class T, class U, class F>
+void chain(State<T>& source, State<U>& next, F& f, std::false_type /* void source */) {
+    fulfil(next, [&source, &f](){
+        return f(source.take());
+    });
+}
+
+template <class T, class U, class F>
+void chain(State<T>& /*source*/, State<U>& next, F& f, std::true_type /* void source */) {
+    fulfil(next, [&f](){
+        return f();
+    });
+}
+
+// Feeds the source's outcome into f, errors skip f and pass through.
+template <class T, class U, class F>
+void chain(State<T>& source, State<U>& next, F& f) {
+    if (source.failure()) {
+        next.fail(source.failure());
+        return;
+    }
+    chain(source, next, f, std::is_void<T>{});
+}
+
+} // namespace __impl
+
+
+// Single-consumer future over an intrusive shared state. get() throws
+// what the operation threw, or CancelledError when it never ran.
+template <class T>
+class Future {
+public:
+    using State = __impl::State<T>;
+
+    Future() noexcept = default;
+
+    explicit Future(__impl::Ref<State> state) noexcept
+            : state { std::move(state) } {}
+
+    Future(Future&&) noexcept = default;
+    Future& operator=(Future&&) noexcept = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    bool valid() const noexcept {
+        return static_cast<bool>(state);
+    }
+
+    bool ready() const {
+        assert(valid());
+        return state->ready();
+    }
+
+    void wait() const {
+        assert(valid());
+        state->wait();
+    }
+
+    T get() {
+        assert(valid());
+        const auto owned = std::move(state);
+        return owned->get();
+    }
+
+    // f(T) runs on the thread that completes this future, for an actor
+    // call that is the actor itself; inline if it's already complete.
+    template <class F>
+    Future<__impl::continuation_result_t<F, T>> then(F&& f) {
+        using U = __impl::continuation_result_t<F, T>;
+        assert(valid());
+        __impl::Ref<__impl::State<U>> next { new __impl::State<U> };
+        auto source = std::move(state);
+        const auto raw = source.get();
+        raw->on_complete([source, next, f = std::forward<F>(f)]() mutable {
+            __impl::chain(*source, *next, f);
+        });
+        return Future<U>(std::move(next));
+    }
+
+    // Same, but f is posted to executor (anything with post(callable)).
+    template <class Executor, class F>
+    Future<__impl::continuation_result_t<F, T>> then(Executor& executor, F&& f) {
+        using U = __impl::continuation_result_t<F, T>;
+        assert(valid());
+        __impl::Ref<__impl::State<U>> next { new __impl::State<U> };
+        auto source = std::move(state);
+        const auto raw = source.get();
+        raw->on_complete([&executor, source, next, f = std::forward<F>(f)]() mutable {
+            executor.post([source, next, f = std::move(f)]() mutable {
+                __impl::chain(*source, *next, f);
+            });
+        });
+        return Future<U>(std::move(next));
+    }
+
+private:
+    __impl::Ref<State> state;
+};
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_FUTURE_H
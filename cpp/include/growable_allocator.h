@@ -0,0 +1,88 @@
+#ifndef CPP_UTILS_GROWABLE_ALLOCATOR_H
+#define CPP_UTILS_GROWABLE_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "merge_allocator.h"
+
+enum class HugePages {
+    none,
+    // madvise(MADV_HUGEPAGE): the kernel backs what it can with huge pages
+    transparent,
+    // MAP_HUGETLB from the reserved pool, transparent if it is exhausted
+    hugetlb,
+};
+
+// One private anonymous mapping. Pages are only backed once touched, and
+// free ranges the allocator offers back are dropped with
+// madvise(MADV_DONTNEED), in whole pages of the mapping.
+class MmapArena
+    : public ArenaHolder {
+public:
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    // Rounds size up to whole pages; throws std::bad_alloc if nothing can
+    // be mapped.
+    MmapArena(size_t size, HugePages huge_pages, size_t release_threshold);
+    ~MmapArena() override;
+
+    MmapArena(const MmapArena&) = delete;
+    MmapArena& operator=(const MmapArena&) = delete;
+
+    char* begin() noexcept override;
+    size_t size() const noexcept override;
+    size_t releaseThreshold() const noexcept override;
+    void release(char* begin, size_t size) noexcept override;
+
+    size_t pageSize() const noexcept;
+
+private:
+    char* start = nullptr;
+    size_t length = 0;
+    size_t page;
+    const size_t release_threshold;
+};
+
+// MergeAllocator over as many MmapArenas as it takes: when none of the
+// chunks has room, another one of chunk_size, or of the request if that is
+// bigger, is mapped. Chunks are never unmapped, but large free ranges give
+// their memory back to the kernel, so the resident size shrinks after a
+// spike. Not thread-safe, like MergeAllocator.
+class GrowableAllocator {
+public:
+    struct Options {
+        size_t chunk_size = 64 * 1024 * 1024;
+        HugePages huge_pages = HugePages::none;
+        // smallest free range handed back to the kernel, 0 for never
+        size_t release_threshold = 1024 * 1024;
+    };
+
+    GrowableAllocator();
+    explicit GrowableAllocator(const Options& options);
+    ~GrowableAllocator();
+
+    GrowableAllocator(const GrowableAllocator&) = delete;
+    GrowableAllocator& operator=(const GrowableAllocator&) = delete;
+
+    char* allocate(size_t size) noexcept;
+    void deallocate(char* ptr, size_t size) noexcept;
+
+    size_t chunkCount() const noexcept;
+
+private:
+    struct Chunk;
+
+    Chunk* chunkOf(const char* ptr) const noexcept;
+    Chunk* grow(size_t size) noexcept;
+
+    const Options options;
+    // by address
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    // where the last allocation succeeded, tried first
+    Chunk* current = nullptr;
+};
+
+
+#endif //CPP_UTILS_GROWABLE_ALLOCATOR_H
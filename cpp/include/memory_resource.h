@@ -0,0 +1,59 @@
+#ifndef CPP_UTILS_MEMORY_RESOURCE_H
+#define CPP_UTILS_MEMORY_RESOURCE_H
+
+#if __cplusplus < 201703L
+#error "memory_resource.h needs C++17 std::pmr"
+#endif
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "merge_allocator.h"
+
+
+// std::pmr::memory_resource over a MergeAllocator, for the pmr containers:
+//
+//     MergeResource resource(allocator);
+//     std::pmr::unordered_map<int, std::pmr::string> names(&resource);
+//
+// Resources over the same MergeAllocator are equal, memory from one can be
+// given back through the other.
+class MergeResource
+    : public std::pmr::memory_resource {
+public:
+    explicit MergeResource(MergeAllocator& allocator) noexcept
+        : allocator { allocator } {}
+
+    MergeAllocator& arena() const noexcept {
+        return allocator;
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        const auto ptr = allocator.allocateAligned(nonEmpty(bytes), alignment);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t /*alignment*/) override {
+        allocator.deallocate(static_cast<char*>(ptr), nonEmpty(bytes));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        const auto resource = dynamic_cast<const MergeResource*>(&other);
+        return resource != nullptr && &resource->allocator == &allocator;
+    }
+
+    // pmr allows zero sized requests, MergeAllocator doesn't
+    static size_t nonEmpty(size_t bytes) noexcept {
+        return bytes == 0 ? 1 : bytes;
+    }
+
+    MergeAllocator& allocator;
+};
+
+
+#endif //CPP_UTILS_MEMORY_RESOURCE_H
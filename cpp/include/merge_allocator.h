@@ -6,19 +6,84 @@
 #define CPP_UTILS_MERGE_ALLOCATOR_H
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
 
 class ArenaHolder {
 public:
     virtual ~ArenaHolder() = default;
     virtual char* begin() noexcept = 0;
     virtual size_t size() const noexcept = 0;
+
+    // Free blocks of at least releaseThreshold() bytes, 0 for never, are
+    // offered back through release() when a deallocate leaves them free,
+    // once at least that many bytes were freed into them since they were
+    // last offered: [begin, begin + size) holds no allocator bookkeeping,
+    // so the arena may drop its pages. They have to read as any bytes
+    // afterwards.
+    virtual size_t releaseThreshold() const noexcept { return 0; }
+    virtual void release(char* /*begin*/, size_t /*size*/) noexcept {}
+
+    // Storage for the allocator's bitmaps, a bit per 8 bytes of arena,
+    // aligned for uint64_t: from the heap unless the holder has a better
+    // place. On nullptr the allocator keeps them at the end of the arena,
+    // which it then hands out less of.
+    virtual void* allocateMetadata(size_t size) noexcept { return ::operator new(size, std::nothrow); }
+    virtual void deallocateMetadata(void* ptr, size_t /*size*/) noexcept { ::operator delete(ptr); }
 };
 
 struct Node;
 
+// Snapshot of a MergeAllocator. Taking one is cheap, counters are kept up
+// to date as the allocator runs, only the largest block is looked for.
+struct MergeAllocatorStats {
+    static constexpr size_t size_buckets = 32;
+
+    size_t arena_bytes = 0;
+    size_t used_bytes = 0;
+    size_t free_bytes = 0;
+    size_t free_blocks = 0;
+    size_t largest_free_block = 0;
+    // 1 - largest_free_block / free_bytes: 0 if the free memory is one
+    // block, close to 1 if it is crumbs. An allocation failing at low
+    // fragmentation means the arena is full.
+    double fragmentation = 0;
+    // free blocks of [16 << i, 16 << (i + 1)) bytes
+    size_t free_blocks_by_size[size_buckets] = {};
+
+    // calls to allocate and allocateAligned, those that failed included
+    uint64_t allocations = 0;
+    uint64_t failed_allocations = 0;
+    uint64_t deallocations = 0;
+    // a reallocate that moves the block counts as allocate and deallocate
+    // too
+    uint64_t reallocations = 0;
+    // free list nodes looked at by all the calls
+    uint64_t visited_nodes = 0;
+};
+
+// A stretch of the arena reported by MergeAllocator::walk. Allocated
+// blocks carry no header, so a used one covers all the allocations
+// between two free blocks.
+struct HeapBlock {
+    char* begin;
+    size_t size;
+    bool free;
+};
+
+// Arena allocator handing out multiples of 16 bytes. Free blocks are
+// indexed by a two-level segregated fit (TLSF) table: a first level per
+// power of two split into 16 linear classes, with bitmaps to find the
+// smallest non-empty class that fits in constant time. Adjacent free
+// blocks are merged on deallocate; bitmaps marking where free blocks start
+// and end find them in constant time too, so allocated blocks carry no
+// header. The bitmaps live out of the arena, in the holder's metadata
+// storage, or in the allocator itself for arenas of up to 1 KiB.
 class MergeAllocator {
 public:
     explicit MergeAllocator(ArenaHolder& holder) noexcept ;
+    ~MergeAllocator();
 
     MergeAllocator(const MergeAllocator& copy) = delete;
     MergeAllocator& operator=(const MergeAllocator& copy) = delete;
@@ -26,9 +91,71 @@ public:
     char* allocate(size_t size) noexcept ;
     void deallocate(char* ptr, size_t size) noexcept ;
 
+    // A block starting on a multiple of alignment, a power of two; freed
+    // with deallocate like any other. The padding in front of it stays
+    // free. Beyond 16 it needs an arena starting on a multiple of 16.
+    char* allocateAligned(size_t size, size_t alignment) noexcept ;
+
+    // Shrinks the block in place, or grows it into the free block right
+    // after it; only if that is too small does it move, to a new block
+    // of allocate(new_size), copying old_size bytes. Returns nullptr and
+    // leaves the block as is if there is no room.
+    char* reallocate(char* ptr, size_t old_size, size_t new_size) noexcept ;
+
+    // what every block is aligned to: 16, or less if the arena doesn't
+    // start on a multiple of 16
+    size_t alignment() const noexcept ;
+
+    MergeAllocatorStats stats() const noexcept ;
+    // The arena from start to end, in alternating free and used blocks.
+    // For debugging, it's linear in the arena size.
+    void walk(const std::function<void(const HeapBlock&)>& visit) const ;
+
 private:
+    static constexpr unsigned second_level_bits = 4;
+    static constexpr size_t second_levels = size_t(1) << second_level_bits;
+    // block sizes are 32 bit granule counts
+    static constexpr size_t first_levels = 32 - second_level_bits + 1;
+
+    Node* node(uint32_t offset) const noexcept;
+    uint32_t offset(const Node* node) const noexcept;
+
+    void insert(Node* node) noexcept;
+    void remove(Node* node) noexcept;
+    Node* find(size_t granules) const noexcept;
+    void free(Node* block) noexcept;
+    Node* coalesce(Node* block) noexcept;
+    Node* leftNeighbour(uint32_t start) const noexcept;
+    Node* rightNeighbour(uint32_t end) const noexcept;
+
     ArenaHolder& holder;
-    Node* head;
+    char* const begin;
+    uint32_t granules;
+    // in granules, 0 if the arena takes nothing back
+    const size_t release_threshold;
+
+    uint32_t first_level_map = 0;
+    uint32_t second_level_maps[first_levels] = {};
+    // offsets of the heads of the per-class free lists
+    uint32_t free_lists[first_levels][second_levels];
+    // one bit per granule for the first and for the last granule of each
+    // free block, in metadata, or in inline_maps for arenas of up to 64
+    // granules, or in the arena after the granules if the holder has no
+    // storage for them
+    uint64_t* free_starts;
+    uint64_t* free_ends;
+    uint64_t inline_maps[2] = {};
+    void* metadata = nullptr;
+    size_t metadata_size = 0;
+
+    size_t free_granules = 0;
+    size_t free_blocks_by_size[MergeAllocatorStats::size_buckets] = {};
+    uint64_t allocations = 0;
+    uint64_t failed_allocations = 0;
+    uint64_t deallocations = 0;
+    uint64_t reallocations = 0;
+    // counted in const lookups as well
+    mutable uint64_t visited_nodes = 0;
 };
 
 
@@ -0,0 +1,84 @@
+#ifndef CPP_UTILS_MONOTONIC_ALLOCATOR_H
+#define CPP_UTILS_MONOTONIC_ALLOCATOR_H
+
+#include <cstddef>
+
+#include "merge_allocator.h"
+
+// Bump allocator over an arena, for memory that dies all at once, like
+// everything a request allocates. Nothing is freed one by one: a
+// checkpoint marks the current top, and rewinding to it drops all
+// allocated after it with a pointer reset.
+//
+//     {
+//         MonotonicAllocator::Scope request(monotonic);
+//         ... monotonic.allocate(...) ...
+//     } // all of it is gone
+//
+// What doesn't fit in the arena any more is taken from the fallback
+// MergeAllocator and given back there on rewind too. What has to outlive
+// the scope goes to the fallback directly, see allocateLasting.
+class MonotonicAllocator {
+public:
+    struct Overflow;
+
+    // the top to rewind to
+    struct Checkpoint {
+        char* top;
+        Overflow* overflow;
+    };
+
+    // Rewinds to where the allocator was when the scope was entered.
+    // Scopes nest, the inner one has to end first.
+    class Scope {
+    public:
+        explicit Scope(MonotonicAllocator& allocator) noexcept
+            : allocator { allocator }
+            , checkpoint { allocator.checkpoint() } {}
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            allocator.rewind(checkpoint);
+        }
+
+    private:
+        MonotonicAllocator& allocator;
+        const Checkpoint checkpoint;
+    };
+
+    MonotonicAllocator(ArenaHolder& holder, MergeAllocator& fallback) noexcept;
+    ~MonotonicAllocator();
+
+    MonotonicAllocator(const MonotonicAllocator&) = delete;
+    MonotonicAllocator& operator=(const MonotonicAllocator&) = delete;
+
+    // alignment is a power of two
+    char* allocate(size_t size, size_t alignment = 16) noexcept;
+    // nothing: the memory comes back on rewind
+    void deallocate(char* /*ptr*/, size_t /*size*/) noexcept {}
+
+    // From the fallback, untouched by rewinds; freed with deallocateLasting.
+    char* allocateLasting(size_t size, size_t alignment = 16) noexcept;
+    void deallocateLasting(char* ptr, size_t size) noexcept;
+
+    Checkpoint checkpoint() const noexcept;
+    void rewind(const Checkpoint& checkpoint) noexcept;
+    // back to empty
+    void reset() noexcept;
+
+    // bytes taken from the arena, padding included
+    size_t used() const noexcept;
+
+private:
+    char* const begin;
+    char* const end;
+    char* top;
+    MergeAllocator& fallback;
+    // allocations that went to the fallback, the latest first
+    Overflow* overflow = nullptr;
+};
+
+
+#endif //CPP_UTILS_MONOTONIC_ALLOCATOR_H
@@ -0,0 +1,68 @@
+#ifndef CPP_UTILS_MUTEX_H
+#define CPP_UTILS_MUTEX_H
+
+#include <mutex>
+#include <utility>
+
+
+namespace utils {
+
+// Value that can only be reached through lock(), which holds mutex_type
+// for as long as the returned wrapper lives:
+//
+//     if (auto locked = value.lock()) { locked->modify(); }
+template <class T, class mutex_type = std::mutex>
+class mutex {
+public:
+    explicit mutex(T&& t)
+            : t { std::move(t) } {}
+
+    mutex(mutex&& m)
+            : t { std::move(m.t) } {}
+
+    class mutexed_wrapper {
+    public:
+        explicit mutexed_wrapper(mutex& m)
+                : mutex_ { m }
+                , lock { mutex_.m } {}
+
+        mutexed_wrapper(mutexed_wrapper&& wrapper)
+                : mutex_ { wrapper.mutex_ }
+                , lock { mutex_.m } {}
+
+        T* operator->() {
+            return &mutex_.t;
+        }
+
+        T& operator*() {
+            return mutex_.t;
+        }
+
+        operator bool() {
+            return true;
+        }
+
+    private:
+        mutex& mutex_;
+        std::lock_guard<mutex_type> lock;
+    };
+
+    mutexed_wrapper lock() {
+        return mutexed_wrapper(*this);
+    }
+
+
+private:
+    T t;
+    mutex_type m;
+};
+
+template <class T>
+mutex<T> make_mutex(T&& t) {
+    return mutex<T>(std::move(t));
+}
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_MUTEX_H
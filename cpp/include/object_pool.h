@@ -0,0 +1,189 @@
+#ifndef CPP_UTILS_OBJECT_POOL_H
+#define CPP_UTILS_OBJECT_POOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "merge_allocator.h"
+
+// Slots for objects of one type, carved from an arena or from slabs of a
+// MergeAllocator, without per-object bookkeeping: a free slot holds the
+// link of the free list, and allocating or freeing one is a pointer swap.
+// Slots of a slab are handed out in address order, and freed ones are
+// reused last in first out, while they are still in cache.
+//
+//     ObjectPool<Connection> connections(allocator);
+//     const auto connection = connections.create(socket);
+//     ...
+//     connections.destroy(connection);
+//
+// Not thread-safe. Objects still alive when the pool goes are not
+// destroyed, the memory is just given back.
+template <class T>
+class ObjectPool {
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    // Header of a slab taken from a MergeAllocator, the slots follow it.
+    struct Slab {
+        Slab* next;
+        size_t size;
+    };
+
+public:
+    static constexpr size_t slot_alignment = std::max(alignof(T), alignof(FreeSlot));
+    static constexpr size_t slot_size = (std::max(sizeof(T), sizeof(FreeSlot)) + slot_alignment - 1) / slot_alignment * slot_alignment;
+
+    // As many slots as fit in the arena, and no more.
+    explicit ObjectPool(ArenaHolder& holder) noexcept {
+        const auto end = holder.begin() + holder.size();
+        fresh = std::min(alignUp(holder.begin(), slot_alignment), end);
+        fresh_end = fresh + size_t(end - fresh) / slot_size * slot_size;
+    }
+
+    // Grows by slabs of slots_per_slab slots from the allocator, and gives
+    // them back when destroyed.
+    explicit ObjectPool(MergeAllocator& source, size_t slots_per_slab = 64) noexcept
+        : source { &source }
+        , slots_per_slab { slots_per_slab } {
+        assert(slots_per_slab > 0);
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool() {
+        while (slabs != nullptr) {
+            const auto slab = slabs;
+            slabs = slab->next;
+            source->deallocate(reinterpret_cast<char*>(slab), slab->size);
+        }
+    }
+
+    // An uninitialized slot, or nullptr if there is no room left.
+    void* allocate() noexcept {
+        if (free_list != nullptr) {
+            const auto slot = free_list;
+            free_list = slot->next;
+            ++used;
+            return slot;
+        }
+        if (fresh == fresh_end && !grow()) {
+            return nullptr;
+        }
+        const auto slot = fresh;
+        fresh += slot_size;
+        ++used;
+        return slot;
+    }
+
+    // Fills slots with up to count slots, returns how many it got.
+    size_t allocate(void** slots, size_t count) noexcept {
+        size_t taken = 0;
+        for (; taken < count && free_list != nullptr; ++taken) {
+            slots[taken] = free_list;
+            free_list = free_list->next;
+        }
+        while (taken < count && (fresh != fresh_end || grow())) {
+            const auto fresh_slots = std::min(count - taken, size_t(fresh_end - fresh) / slot_size);
+            for (size_t i = 0; i < fresh_slots; ++i, fresh += slot_size) {
+                slots[taken++] = fresh;
+            }
+        }
+        used += taken;
+        return taken;
+    }
+
+    void deallocate(void* slot) noexcept {
+        assert(slot != nullptr && used > 0);
+        const auto freed = static_cast<FreeSlot*>(slot);
+        freed->next = free_list;
+        free_list = freed;
+        --used;
+    }
+
+    void deallocate(void* const* slots, size_t count) noexcept {
+        if (count == 0) {
+            return;
+        }
+        assert(used >= count);
+        // linked up first, spliced in with one write
+        for (size_t i = 0; i + 1 < count; ++i) {
+            static_cast<FreeSlot*>(slots[i])->next = static_cast<FreeSlot*>(slots[i + 1]);
+        }
+        static_cast<FreeSlot*>(slots[count - 1])->next = free_list;
+        free_list = static_cast<FreeSlot*>(slots[0]);
+        used -= count;
+    }
+
+    // nullptr if there is no room; what the constructor throws is passed on
+    template <class... Args>
+    T* create(Args&&... args) {
+        const auto slot = allocate();
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        try {
+            return new (slot) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(slot);
+            throw;
+        }
+    }
+
+    void destroy(T* object) noexcept {
+        object->~T();
+        deallocate(object);
+    }
+
+    // slots handed out and not given back
+    size_t inUse() const noexcept {
+        return used;
+    }
+
+private:
+    static char* alignUp(char* ptr, size_t alignment) noexcept {
+        const auto address = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((address + alignment - 1) / alignment * alignment - address);
+    }
+
+    bool grow() noexcept {
+        if (source == nullptr) {
+            return false;
+        }
+        const auto header = (sizeof(Slab) + slot_alignment - 1) / slot_alignment * slot_alignment;
+        const auto size = header + slots_per_slab * slot_size;
+        const auto block = source->allocateAligned(size, std::max(slot_alignment, alignof(Slab)));
+        if (block == nullptr) {
+            return false;
+        }
+        slabs = new (block) Slab { slabs, size };
+        fresh = block + header;
+        fresh_end = fresh + slots_per_slab * slot_size;
+        return true;
+    }
+
+    MergeAllocator* const source = nullptr;
+    const size_t slots_per_slab = 0;
+    Slab* slabs = nullptr;
+
+    FreeSlot* free_list = nullptr;
+    // not handed out yet
+    char* fresh = nullptr;
+    char* fresh_end = nullptr;
+    size_t used = 0;
+};
+
+template <class T>
+constexpr size_t ObjectPool<T>::slot_alignment;
+
+template <class T>
+constexpr size_t ObjectPool<T>::slot_size;
+
+
+#endif //CPP_UTILS_OBJECT_POOL_H
@@ -0,0 +1,207 @@
+#ifndef CPP_UTILS_PARALLEL_H
+#define CPP_UTILS_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+
+namespace utils {
+
+struct parallel_options {
+    // rows per chunk, 0 for about 64 KiB of values
+    std::size_t chunk_rows = 0;
+    // Reduce the chunks' results in the order of the chunks, so that the
+    // same range gives the same result on any number of threads, even
+    // with a reduction that isn't associative, like adding floats.
+    bool deterministic = false;
+};
+
+namespace __impl {
+
+// Chunks of a loop claimed one at a time by whoever is free: the calling
+// thread and the helpers it posted to a pool. The caller runs chunks too,
+// so the loop finishes even when no helper gets to run, say when the pool
+// is busy or the caller is its only worker. Helpers that come late find
+// nothing to claim and touch nothing but this state, which they share.
+class ChunkClaims {
+public:
+    explicit ChunkClaims(std::size_t chunks) noexcept
+            : chunks { chunks } {}
+
+    // Runs body(chunk) for unclaimed chunks until there are none. Once one
+    // throws, the chunks left are skipped.
+    template <class Body>
+    void run(Body& body) noexcept {
+        for (;;) {
+            const auto chunk = next.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunks) {
+                return;
+            }
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    body(chunk);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            finish();
+        }
+    }
+
+    // Until every chunk is done, then rethrows what the first failed one threw.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this](){ return done == chunks; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void fail(std::exception_ptr exception) noexcept {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!error) {
+            error = std::move(exception);
+        }
+        failed.store(true, std::memory_order_relaxed);
+    }
+
+    void finish() noexcept {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (++done == chunks) {
+            condition.notify_all();
+        }
+    }
+
+    const std::size_t chunks;
+    std::atomic<std::size_t> next { 0 };
+    std::atomic<bool> failed { false };
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::size_t done = 0;
+    std::exception_ptr error;
+};
+
+template <class Iterator>
+std::size_t chunkRows(const parallel_options& options) {
+    if (options.chunk_rows > 0) {
+        return options.chunk_rows;
+    }
+    using value_type = typename std::iterator_traits<Iterator>::value_type;
+    return std::max<std::size_t>(1, (64 << 10) / sizeof(value_type));
+}
+
+// Splits [first, last) in chunks of rows and runs body(from, to, chunk) on
+// each, on the pool and on the calling thread.
+template <class Iterator, class Body>
+void forEachChunk(ThreadPool& pool, Iterator first, Iterator last, std::size_t rows, Body body) {
+    using category = typename std::iterator_traits<Iterator>::iterator_category;
+    static_assert(std::is_base_of<std::random_access_iterator_tag, category>::value,
+                  "the range is split by position, its iterators have to be random access");
+
+    const auto size = std::size_t(last - first);
+    const auto chunks = (size + rows - 1) / rows;
+    if (chunks == 0) {
+        return;
+    }
+    auto chunk = [first, last, rows, chunks, &body](std::size_t index) {
+        const auto from = first + index * rows;
+        const auto to = index + 1 == chunks ? last : from + rows;
+        body(from, to, index);
+    };
+
+    const auto claims = std::make_shared<ChunkClaims>(chunks);
+    const auto helpers = std::min(pool.size(), chunks - 1);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        // A copy of chunk each, a helper may start after this returned.
+        // What it refers to, body, is only used for claimed chunks, and
+        // wait() outlasts those.
+        pool.post([claims, chunk](){ claims->run(chunk); });
+    }
+    claims->run(chunk);
+    claims->wait();
+}
+
+} // namespace __impl
+
+
+// Calls fn on every row of a random access range, utils::zip of vectors
+// say, in chunks spread over the pool's workers and the calling thread:
+//
+//     utils::parallel_for_each(pool, utils::zip(x, y, z), [a](auto&& row) {
+//         std::get<2>(row) = a * std::get<0>(row) + std::get<1>(row);
+//     });
+//
+// fn is called concurrently from several threads. What it throws comes
+// out of here once the chunks running at the time are done, the rest are
+// skipped. Safe to call from the pool's own workers.
+template <class Range, class F>
+void parallel_for_each(ThreadPool& pool, Range&& range, F fn, const parallel_options& options = {}) {
+    using std::begin;
+    using std::end;
+    const auto first = begin(range);
+    const auto last = end(range);
+    __impl::forEachChunk(pool, first, last, __impl::chunkRows<decltype(first)>(options), [&fn](auto from, auto to, std::size_t) {
+        for (; from != to; ++from) {
+            fn(*from);
+        }
+    });
+}
+
+// reduce(init, transform(row)...) over a random access range, in chunks
+// like parallel_for_each. Each chunk is reduced on its own, starting from
+// its first row, and the chunks' results are then reduced into init, as
+// they finish, or in order when options.deterministic is set. reduce has
+// to be associative, and transform and reduce may run concurrently.
+template <class Range, class T, class Reduce, class Transform>
+T transform_reduce(ThreadPool& pool, Range&& range, T init, Reduce reduce, Transform transform, const parallel_options& options = {}) {
+    using std::begin;
+    using std::end;
+    const auto first = begin(range);
+    const auto last = end(range);
+    const auto rows = __impl::chunkRows<decltype(first)>(options);
+
+    auto reduceChunk = [&reduce, &transform](auto from, auto to) {
+        T partial = transform(*from);
+        for (++from; from != to; ++from) {
+            partial = reduce(std::move(partial), transform(*from));
+        }
+        return partial;
+    };
+
+    if (options.deterministic) {
+        // a result per chunk, each written by the thread that ran it
+        std::vector<std::unique_ptr<T>> partials((std::size_t(last - first) + rows - 1) / rows);
+        __impl::forEachChunk(pool, first, last, rows, [&](auto from, auto to, std::size_t chunk) {
+            partials[chunk].reset(new T(reduceChunk(from, to)));
+        });
+        for (auto& partial : partials) {
+            init = reduce(std::move(init), std::move(*partial));
+        }
+        return init;
+    }
+
+    std::mutex mutex;
+    __impl::forEachChunk(pool, first, last, rows, [&](auto from, auto to, std::size_t) {
+        auto partial = reduceChunk(from, to);
+        std::lock_guard<std::mutex> guard(mutex);
+        init = reduce(std::move(init), std::move(partial));
+    });
+    return init;
+}
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_PARALLEL_H
@@ -0,0 +1,160 @@
+#ifndef CPP_UTILS_SMALL_FUNCTION_H
+#define CPP_UTILS_SMALL_FUNCTION_H
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace utils {
+
+// Move-only type-erased callable. Targets up to Capacity bytes live inline,
+// bigger (or throwing-move) ones fall back to a single heap allocation.
+template <class Signature, std::size_t Capacity = 48>
+class SmallFunction;
+
+template <class R, class... Args, std::size_t Capacity>
+class SmallFunction<R(Args...), Capacity> {
+    static_assert(Capacity >= sizeof(void*), "heap fallback stores a pointer inline");
+public:
+    SmallFunction() noexcept = default;
+
+    SmallFunction(std::nullptr_t) noexcept {}
+
+    template <class F, class = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, SmallFunction>::value>::type>
+    SmallFunction(F&& f) {
+        using Target = typename std::decay<F>::type;
+        emplace<Target>(std::forward<F>(f), std::integral_constant<bool, fits_inline<Target>()>{});
+    }
+
+    SmallFunction(SmallFunction&& other) noexcept {
+        take(other);
+    }
+
+    SmallFunction& operator=(SmallFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    SmallFunction(const SmallFunction&) = delete;
+    SmallFunction& operator=(const SmallFunction&) = delete;
+
+    ~SmallFunction() {
+        reset();
+    }
+
+    R operator()(Args... args) {
+        assert(ops != nullptr);
+        return ops->invoke(&storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept {
+        return ops != nullptr;
+    }
+
+    // true when the target didn't fit into the inline buffer
+    bool on_heap() const noexcept {
+        return ops != nullptr && ops->heap;
+    }
+
+    void reset() noexcept {
+        if (ops != nullptr) {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+    static constexpr std::size_t capacity = Capacity;
+
+private:
+    using Storage = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+
+    struct Ops {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void* to, void* from) noexcept;
+        void (*destroy)(void*) noexcept;
+        bool heap;
+    };
+
+    template <class F>
+    static constexpr bool fits_inline() {
+        return sizeof(F) <= Capacity
+               && alignof(F) <= alignof(Storage)
+               && std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template <class F>
+    struct Inline {
+        static R invoke(void* self, Args&&... args) {
+            return (*static_cast<F*>(self))(std::forward<Args>(args)...);
+        }
+        static void move(void* to, void* from) noexcept {
+            new (to) F(std::move(*static_cast<F*>(from)));
+            static_cast<F*>(from)->~F();
+        }
+        static void destroy(void* self) noexcept {
+            static_cast<F*>(self)->~F();
+        }
+        static constexpr Ops ops { &invoke, &move, &destroy, false };
+    };
+
+    template <class F>
+    struct Heap {
+        static F*& target(void* self) noexcept {
+            return *static_cast<F**>(self);
+        }
+        static R invoke(void* self, Args&&... args) {
+            return (*target(self))(std::forward<Args>(args)...);
+        }
+        static void move(void* to, void* from) noexcept {
+            new (to) F*(target(from));
+        }
+        static void destroy(void* self) noexcept {
+            delete target(self);
+        }
+        static constexpr Ops ops { &invoke, &move, &destroy, true };
+    };
+
+    template <class F, class U>
+    void emplace(U&& f, std::true_type /* inline */) {
+        new (&storage) F(std::forward<U>(f));
+        ops = &Inline<F>::ops;
+    }
+
+    template <class F, class U>
+    void emplace(U&& f, std::false_type /* inline */) {
+        new (&storage) F*(new F(std::forward<U>(f)));
+        ops = &Heap<F>::ops;
+    }
+
+    void take(SmallFunction& other) noexcept {
+        if (other.ops != nullptr) {
+            other.ops->move(&storage, &other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    Storage storage;
+    const Ops* ops = nullptr;
+};
+
+template <class R, class... Args, std::size_t Capacity>
+template <class F>
+constexpr typename SmallFunction<R(Args...), Capacity>::Ops SmallFunction<R(Args...), Capacity>::Inline<F>::ops;
+
+template <class R, class... Args, std::size_t Capacity>
+template <class F>
+constexpr typename SmallFunction<R(Args...), Capacity>::Ops SmallFunction<R(Args...), Capacity>::Heap<F>::ops;
+
+template <class R, class... Args, std::size_t Capacity>
+constexpr std::size_t SmallFunction<R(Args...), Capacity>::capacity;
+
+} // namespace utils
+
+#endif //CPP_UTILS_SMALL_FUNCTION_H
@@ -0,0 +1,359 @@
+#ifndef CPP_UTILS_SOA_VECTOR_H
+#define CPP_UTILS_SOA_VECTOR_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "zip.h"
+
+namespace utils {
+
+// A column of a soa_vector, or any array: a pointer and a size.
+template <class T>
+class column_span {
+public:
+    using value_type = std::remove_cv_t<T>;
+    using reference = T&;
+    using iterator = T*;
+
+    column_span(T* data, std::size_t size) noexcept
+            : data_ { data }
+            , size_ { size } {}
+
+    T* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    T& operator[](std::size_t index) const noexcept {
+        assert(index < size_);
+        return data_[index];
+    }
+
+    T* begin() const noexcept { return data_; }
+    T* end() const noexcept { return data_ + size_; }
+
+private:
+    T* data_;
+    std::size_t size_;
+};
+
+
+// Records of fields Ts... stored as structure of arrays: each field in a
+// column of its own, the columns one after another in a single allocation,
+// each starting on a column_alignment boundary. A query over one or two
+// fields streams just those columns through the cache:
+//
+//     soa_vector<int, float, std::string> particles;
+//     particles.push_back(std::make_tuple(1, 0.5f, "one"));
+//     for (auto&& row : utils::zip(particles.column<0>(), particles.column<1>())) {
+//         std::get<1>(row) *= std::get<0>(row);
+//     }
+//
+// Rows are zip references: tuples of references into the columns that
+// assign through, and the row iterators are the zip's, random access, so
+// std algorithms reorder whole rows, moving the fields rather than copying
+// them. The fields have to be nothrow movable, moving them to a bigger
+// allocation can't fail halfway.
+template <class ...Ts>
+class soa_vector {
+    static_assert(sizeof...(Ts) > 0, "a soa_vector needs a column");
+    static_assert(std::is_nothrow_move_constructible<std::tuple<Ts...>>::value, "fields are moved between allocations");
+public:
+    using value_type = std::tuple<Ts...>;
+    using reference = __impl::ZipReference<Ts&...>;
+    using const_reference = __impl::ZipReference<const Ts&...>;
+    using iterator = typename __impl::ZipContainer<column_span<Ts>...>::ZipIterator;
+    using const_iterator = typename __impl::ZipContainer<column_span<const Ts>...>::ZipIterator;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    // a cache line, and as much as the widest vector loads want
+    static constexpr std::size_t column_alignment = std::max({ std::size_t(64), alignof(Ts)... });
+
+    template <std::size_t I>
+    using field_type = std::tuple_element_t<I, value_type>;
+
+    soa_vector() noexcept = default;
+
+    soa_vector(const soa_vector& other)
+            : soa_vector() {
+        reserve(other.size());
+        for (std::size_t row = 0; row < other.size(); ++row) {
+            emplaceFrom(other[row], std::index_sequence_for<Ts...>());
+        }
+    }
+
+    soa_vector(soa_vector&& other) noexcept
+            : block { other.block }
+            , columns { other.columns }
+            , size_ { other.size_ }
+            , capacity_ { other.capacity_ } {
+        other.block = nullptr;
+        other.columns = std::tuple<Ts*...>();
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    soa_vector& operator=(const soa_vector& other) {
+        if (this != &other) {
+            soa_vector copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    soa_vector& operator=(soa_vector&& other) noexcept {
+        soa_vector moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~soa_vector() {
+        clear();
+        ::operator delete(block);
+    }
+
+    void swap(soa_vector& other) noexcept {
+        std::swap(block, other.block);
+        std::swap(columns, other.columns);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    std::size_t size() const noexcept { return size_; }
+    std::size_t capacity() const noexcept { return capacity_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    // One allocation for all the columns, with room for capacity rows.
+    void reserve(std::size_t capacity) {
+        if (capacity > capacity_) {
+            reallocate(capacity, [](std::tuple<Ts*...>) {});
+        }
+    }
+
+    // one field per column
+    template <class ...Us>
+    void emplace_back(Us&& ...fields) {
+        static_assert(sizeof...(Us) == sizeof...(Ts), "a field for every column");
+        if (size_ == capacity_) {
+            // the new row is made in the new columns before the old ones go,
+            // so fields taken from this vector's own rows stay valid
+            reallocate(std::max<std::size_t>(2 * capacity_, 8), [&](std::tuple<Ts*...> bigger) {
+                construct<0>(bigger, size_, std::forward<Us>(fields)...);
+            });
+        } else {
+            construct<0>(columns, size_, std::forward<Us>(fields)...);
+        }
+        ++size_;
+    }
+
+    void push_back(const value_type& row) {
+        emplaceFrom(row, std::index_sequence_for<Ts...>());
+    }
+
+    void push_back(value_type&& row) {
+        emplaceFrom(std::move(row), std::index_sequence_for<Ts...>());
+    }
+
+    void pop_back() noexcept {
+        assert(size_ > 0);
+        destroy(size_ - 1, size_);
+        --size_;
+    }
+
+    void clear() noexcept {
+        destroy(0, size_);
+        size_ = 0;
+    }
+
+    // Removes rows moving the following ones down, column by column.
+    iterator erase(iterator first, iterator last) {
+        const auto from = std::size_t(first - begin());
+        const auto count = std::size_t(last - first);
+        assert(from + count <= size_);
+        if (count > 0) {
+            shiftDown(from, count, std::index_sequence_for<Ts...>());
+            destroy(size_ - count, size_);
+            size_ -= count;
+        }
+        return begin() + from;
+    }
+
+    iterator erase(iterator position) {
+        return erase(position, position + 1);
+    }
+
+    // Reorders the rows by the field of column I.
+    template <std::size_t I, class Compare = std::less<>>
+    void sort_by(Compare compare = Compare()) {
+        std::sort(begin(), end(), [&compare](const auto& lhs, const auto& rhs) {
+            return compare(std::get<I>(lhs), std::get<I>(rhs));
+        });
+    }
+
+    reference operator[](std::size_t row) noexcept {
+        assert(row < size_);
+        return row_at<reference>(columns, row, std::index_sequence_for<Ts...>());
+    }
+
+    const_reference operator[](std::size_t row) const noexcept {
+        assert(row < size_);
+        return row_at<const_reference>(columns, row, std::index_sequence_for<Ts...>());
+    }
+
+    template <std::size_t I>
+    column_span<field_type<I>> column() noexcept {
+        return { std::get<I>(columns), size_ };
+    }
+
+    template <std::size_t I>
+    column_span<const field_type<I>> column() const noexcept {
+        return { std::get<I>(columns), size_ };
+    }
+
+    iterator begin() noexcept { return rows(std::index_sequence_for<Ts...>()).begin(); }
+    iterator end() noexcept { return rows(std::index_sequence_for<Ts...>()).end(); }
+    const_iterator begin() const noexcept { return rows(std::index_sequence_for<Ts...>()).begin(); }
+    const_iterator end() const noexcept { return rows(std::index_sequence_for<Ts...>()).end(); }
+
+private:
+    // Where each column starts in a block for capacity rows, and at the
+    // end how big the block is.
+    static std::array<std::size_t, sizeof...(Ts) + 1> layout(std::size_t capacity) {
+        const std::size_t sizes[] = { sizeof(Ts)... };
+        std::array<std::size_t, sizeof...(Ts) + 1> offsets {};
+        for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+            if (capacity > (SIZE_MAX - offsets[i] - column_alignment) / sizes[i]) {
+                throw std::bad_alloc();
+            }
+            const auto end = offsets[i] + capacity * sizes[i];
+            offsets[i + 1] = (end + column_alignment - 1) / column_alignment * column_alignment;
+        }
+        return offsets;
+    }
+
+    // Moves the rows to a block for capacity rows, after fill has
+    // constructed what else goes there.
+    template <class Fill>
+    void reallocate(std::size_t capacity, Fill&& fill) {
+        const auto offsets = layout(capacity);
+        // operator new aligns for max_align_t only, the rest is slack
+        const auto raw = ::operator new(offsets.back() + column_alignment);
+        const auto base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + column_alignment - 1) / column_alignment * column_alignment);
+        const auto bigger = columnsAt(base, offsets, std::index_sequence_for<Ts...>());
+        try {
+            fill(bigger);
+        } catch (...) {
+            ::operator delete(raw);
+            throw;
+        }
+        relocate(bigger, std::index_sequence_for<Ts...>());
+        ::operator delete(block);
+        block = raw;
+        columns = bigger;
+        capacity_ = capacity;
+    }
+
+    template <std::size_t ...I>
+    static std::tuple<Ts*...> columnsAt(char* base, const std::array<std::size_t, sizeof...(Ts) + 1>& offsets, std::index_sequence<I...>) {
+        return std::tuple<Ts*...>(reinterpret_cast<Ts*>(base + offsets[I])...);
+    }
+
+    template <std::size_t ...I>
+    void relocate(const std::tuple<Ts*...>& to, std::index_sequence<I...>) noexcept {
+        (void) std::initializer_list<int> { (relocateColumn(std::get<I>(columns), std::get<I>(to)), 0)... };
+    }
+
+    template <class T>
+    void relocateColumn(T* from, T* to) noexcept {
+        for (std::size_t row = 0; row < size_; ++row) {
+            new (to + row) T(std::move(from[row]));
+            from[row].~T();
+        }
+    }
+
+    // The fields of a row from column I on; if one throws the ones before
+    // it are destroyed.
+    template <std::size_t I, class U, class ...Us>
+    static void construct(const std::tuple<Ts*...>& into, std::size_t row, U&& field, Us&& ...rest) {
+        using T = field_type<I>;
+        const auto at = std::get<I>(into) + row;
+        new (at) T(std::forward<U>(field));
+        try {
+            construct<I + 1>(into, row, std::forward<Us>(rest)...);
+        } catch (...) {
+            at->~T();
+            throw;
+        }
+    }
+
+    template <std::size_t I>
+    static void construct(const std::tuple<Ts*...>&, std::size_t) noexcept {}
+
+    template <class Row, std::size_t ...I>
+    void emplaceFrom(Row&& row, std::index_sequence<I...>) {
+        emplace_back(std::get<I>(std::forward<Row>(row))...);
+    }
+
+    template <std::size_t ...I>
+    void shiftDown(std::size_t from, std::size_t count, std::index_sequence<I...>) {
+        (void) std::initializer_list<int> { (std::move(std::get<I>(columns) + from + count, std::get<I>(columns) + size_, std::get<I>(columns) + from), 0)... };
+    }
+
+    void destroy(std::size_t from, std::size_t to) noexcept {
+        destroy(from, to, std::index_sequence_for<Ts...>());
+    }
+
+    template <std::size_t ...I>
+    void destroy(std::size_t from, std::size_t to, std::index_sequence<I...>) noexcept {
+        (void) std::initializer_list<int> { (destroyColumn(std::get<I>(columns), from, to), 0)... };
+    }
+
+    template <class T>
+    static void destroyColumn(T* column, std::size_t from, std::size_t to) noexcept {
+        for (auto row = from; row < to; ++row) {
+            column[row].~T();
+        }
+    }
+
+    template <class Reference, std::size_t ...I>
+    static Reference row_at(const std::tuple<Ts*...>& columns, std::size_t row, std::index_sequence<I...>) noexcept {
+        return Reference(std::get<I>(columns)[row]...);
+    }
+
+    template <std::size_t ...I>
+    auto rows(std::index_sequence<I...>) noexcept {
+        return utils::zip(column<I>()...);
+    }
+
+    template <std::size_t ...I>
+    auto rows(std::index_sequence<I...>) const noexcept {
+        return utils::zip(column<I>()...);
+    }
+
+    void* block = nullptr;
+    std::tuple<Ts*...> columns;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+template <class ...Ts>
+constexpr std::size_t soa_vector<Ts...>::column_alignment;
+
+template <class ...Ts>
+void swap(soa_vector<Ts...>& lhs, soa_vector<Ts...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+} // namespace utils
+
+#endif //CPP_UTILS_SOA_VECTOR_H
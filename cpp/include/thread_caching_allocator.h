@@ -0,0 +1,51 @@
+#ifndef CPP_UTILS_THREAD_CACHING_ALLOCATOR_H
+#define CPP_UTILS_THREAD_CACHING_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+
+#include "merge_allocator.h"
+
+// Thread-safe front end over one arena. Small requests are served from
+// per-thread caches without locking: a cache owns runs, 16 KiB slabs of
+// one size class taken from a central MergeAllocator, and allocates and
+// frees their blocks locally. A block freed by another thread is pushed
+// onto its owner's lock-free return list and picked up by the owner when
+// it runs dry. Runs that become empty go back to the central allocator in
+// batches; requests above max_cached_size go to it directly, under its
+// lock.
+//
+// A thread's cache is handed to the next new thread when it exits. The
+// allocator must outlive its allocations, not the threads that used it.
+class ThreadCachingAllocator {
+public:
+    static constexpr size_t run_size = 16 * 1024;
+    static constexpr size_t max_cached_size = 1024;
+
+    explicit ThreadCachingAllocator(ArenaHolder& holder);
+    ~ThreadCachingAllocator();
+
+    ThreadCachingAllocator(const ThreadCachingAllocator&) = delete;
+    ThreadCachingAllocator& operator=(const ThreadCachingAllocator&) = delete;
+
+    char* allocate(size_t size) noexcept;
+    void deallocate(char* ptr, size_t size) noexcept;
+
+private:
+    struct Run;
+    struct Cache;
+    struct Shared;
+    struct Lease;
+    struct Leases;
+    struct FreeBlock;
+
+    // null if the thread has none and can't get one
+    Cache* cache() noexcept;
+    void freeLocal(Cache& cache, Run* run, FreeBlock* block) noexcept;
+    Run* newRun(Cache& cache, size_t size_class) noexcept;
+
+    std::shared_ptr<Shared> shared;
+};
+
+
+#endif //CPP_UTILS_THREAD_CACHING_ALLOCATOR_H
@@ -0,0 +1,292 @@
+#ifndef CPP_UTILS_THREAD_POOL_H
+#define CPP_UTILS_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "concurrent_queue.h"
+#include "small_function.h"
+
+
+namespace utils {
+
+namespace __impl {
+
+// Chase-Lev deque: the owner pushes and pops at the bottom, thieves take
+// from the top. Replaced arrays are kept until the deque dies because a
+// thief may still be reading from them.
+template <class T>
+class WorkStealingDeque {
+public:
+    WorkStealingDeque()
+            : array { new Array(64) } {
+        arrays.emplace_back(array.load(std::memory_order_relaxed));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void push(T* elem) {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_acquire);
+        auto a = array.load(std::memory_order_relaxed);
+        if (b - t >= static_cast<int64_t>(a->capacity)) {
+            a = grow(a, t, b);
+        }
+        a->put(b, elem);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // owner only
+    T* pop() {
+        const auto b = bottom.load(std::memory_order_relaxed) - 1;
+        const auto a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        auto elem = a->get(b);
+        if (t == b) {
+            // last element, race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                elem = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return elem;
+    }
+
+    // any thread
+    T* steal() {
+        auto t = top.load(std::memory_order_seq_cst);
+        const auto b = bottom.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return nullptr;
+        }
+        const auto elem = array.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return elem;
+    }
+
+    bool empty() const noexcept {
+        return bottom.load(std::memory_order_seq_cst) <= top.load(std::memory_order_seq_cst);
+    }
+
+private:
+    struct Array {
+        explicit Array(std::size_t capacity)
+                : capacity { capacity }
+                , slots { new std::atomic<T*>[capacity] }
+        {}
+
+        T* get(int64_t index) const noexcept {
+            return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T* elem) noexcept {
+            slots[index & (capacity - 1)].store(elem, std::memory_order_relaxed);
+        }
+
+        const std::size_t capacity;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+    };
+
+    Array* grow(Array* old, int64_t t, int64_t b) {
+        const auto bigger = new Array(old->capacity * 2);
+        arrays.emplace_back(bigger);
+        for (auto i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    std::atomic<int64_t> top { 0 };
+    std::atomic<int64_t> bottom { 0 };
+    std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> arrays;
+};
+
+} // namespace __impl
+
+
+// Fixed set of workers with per-worker work-stealing deques. Tasks
+// scheduled from a worker go to its own deque, others go through a shared
+// injection queue. Idle workers steal, then park on an EventCount.
+class ThreadPool {
+public:
+    // Intrusive unit of work, scheduling one doesn't allocate. The pool
+    // doesn't own tasks.
+    class Task {
+    public:
+        virtual void run() = 0;
+    protected:
+        ~Task() = default;
+    };
+
+    explicit ThreadPool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+            : workers(threads) {
+        assert(threads > 0);
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers[i].reset(new Worker);
+        }
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers[i]->thread = std::thread(&ThreadPool::work, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Workers run whatever is still queued before exiting.
+    ~ThreadPool() {
+        stopping.store(true, std::memory_order_seq_cst);
+        event.notify();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    void schedule(Task* task) {
+        const auto self = current();
+        if (self.pool == this) {
+            workers[self.index]->deque.push(task);
+        } else {
+            std::lock_guard<std::mutex> guard(injection_mutex);
+            injection.push(std::move(task));
+            injection_size.fetch_add(1, std::memory_order_seq_cst);
+        }
+        event.notify_one();
+    }
+
+    // Runs a one-off callable, which costs an allocation per call.
+    template <class F>
+    void post(F&& f) {
+        schedule(new Closure(std::forward<F>(f)));
+    }
+
+    std::size_t size() const noexcept {
+        return workers.size();
+    }
+
+    // true on one of this pool's workers
+    bool in_worker() const noexcept {
+        return current().pool == this;
+    }
+
+private:
+    struct Worker {
+        __impl::WorkStealingDeque<Task> deque;
+        std::thread thread;
+    };
+
+    struct Closure : Task {
+        template <class F>
+        explicit Closure(F&& f)
+                : f { std::forward<F>(f) }
+        {}
+
+        void run() override {
+            std::unique_ptr<Closure> self { this };
+            f();
+        }
+
+        SmallFunction<void()> f;
+    };
+
+    struct Current {
+        const ThreadPool* pool;
+        std::size_t index;
+    };
+
+    static Current& current() noexcept {
+        static thread_local Current current { nullptr, 0 };
+        return current;
+    }
+
+    Task* take_injected() {
+        if (injection_size.load(std::memory_order_seq_cst) == 0) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(injection_mutex);
+        if (injection.empty()) {
+            return nullptr;
+        }
+        const auto task = injection.front();
+        injection.pop();
+        injection_size.fetch_sub(1, std::memory_order_seq_cst);
+        return task;
+    }
+
+    Task* find_task(std::size_t index) {
+        if (auto task = workers[index]->deque.pop()) {
+            return task;
+        }
+        if (auto task = take_injected()) {
+            return task;
+        }
+        for (std::size_t i = 1; i < workers.size(); ++i) {
+            if (auto task = workers[(index + i) % workers.size()]->deque.steal()) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    bool has_work() const noexcept {
+        if (injection_size.load(std::memory_order_seq_cst) != 0) {
+            return true;
+        }
+        for (const auto& worker : workers) {
+            if (!worker->deque.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(std::size_t index) {
+        current() = Current { this, index };
+        for (;;) {
+            if (auto task = find_task(index)) {
+                task->run();
+                continue;
+            }
+            const auto key = event.prepare_wait();
+            if (has_work()) {
+                event.cancel_wait();
+                continue;
+            }
+            if (stopping.load(std::memory_order_seq_cst)) {
+                event.cancel_wait();
+                break;
+            }
+            event.wait(key);
+        }
+        current() = Current { nullptr, 0 };
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injection_mutex;
+    __impl::RingQueue<Task*> injection;
+    std::atomic<std::size_t> injection_size { 0 };
+    std::atomic<bool> stopping { false };
+    EventCount event;
+};
+
+} // namespace utils
+
+
+#endif //CPP_UTILS_THREAD_POOL_H
@@ -1,6 +1,8 @@
 #ifndef CPP_ZIP_H
 #define CPP_ZIP_H
 
+#include <algorithm>
+#include <cstddef>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
@@ -31,20 +33,113 @@ auto make_zipped(Args&& ...containers) {
 namespace __impl {
 
 template <class T>
-using value_type_decay_t = typename std::remove_reference<T>::type::value_type;
+using iterator_type_decay_t = decltype(std::begin(std::declval<T>()));
 
+// from the iterator, so that built-in arrays zip too
 template <class T>
-using iterator_type_decay_t = decltype(std::begin(std::declval<T>()));
+using value_type_decay_t = typename std::iterator_traits<iterator_type_decay_t<T>>::value_type;
 
-template <typename... T, std::size_t... I>
-auto subtuple_(const std::tuple<T...>& t, std::index_sequence<I...>) {
-    return std::make_tuple(std::get<I>(t)...);
-}
+template <class T>
+using iterator_reference_t = typename std::iterator_traits<iterator_type_decay_t<T>>::reference;
 
-template <int Trim, typename... T>
-auto subtuple(const std::tuple<T...>& t) {
-    return subtuple_(t, std::make_index_sequence<sizeof...(T) - Trim>());
-}
+// the weakest of the ranges' categories, the tags derive from each other
+template <class ...T>
+using zip_category_t = std::common_type_t<typename std::iterator_traits<iterator_type_decay_t<T>>::iterator_category...>;
+
+// what moving from a reference of type R gives
+template <class R>
+using rvalue_reference_t = std::conditional_t<std::is_lvalue_reference<R>::value, std::remove_reference_t<R>&&, R>;
+
+template <class ...Ts>
+class ZipValue;
+
+// What a zip iterator dereferences to: a tuple of the elements' references,
+// so reading, writing and iterating copies nothing. Assigning to it writes
+// through to the containers. Like the std algorithms, which write
+// std::move(*it), it treats a row that is an rvalue as one to move from:
+// assigning one, *a = *b included, or making the zip's value_type from it
+// moves the elements, while a named row is copied. iter_move on the
+// iterator moves them too.
+template <class ...Refs>
+class ZipReference : public std::tuple<Refs...> {
+public:
+    using std::tuple<Refs...>::tuple;
+
+    ZipReference(const ZipReference&) = default;
+
+    // assigns the elements, never rebinds
+    ZipReference& operator=(const ZipReference& other) {
+        std::tuple<Refs...>::operator=(static_cast<const std::tuple<Refs...>&>(other));
+        return *this;
+    }
+
+    ZipReference& operator=(ZipReference&& other) {
+        moveElements(other, std::index_sequence_for<Refs...>());
+        return *this;
+    }
+
+    template <class ...Us>
+    ZipReference& operator=(const std::tuple<Us...>& values) {
+        std::tuple<Refs...>::operator=(values);
+        return *this;
+    }
+
+    template <class ...Us>
+    ZipReference& operator=(std::tuple<Us...>&& values) {
+        std::tuple<Refs...>::operator=(std::move(values));
+        return *this;
+    }
+
+    // moves the elements back in, what the std algorithms do with a value
+    // they took out
+    template <class ...Us>
+    ZipReference& operator=(ZipValue<Us...>&& values) {
+        std::tuple<Refs...>::operator=(static_cast<std::tuple<Us...>&&>(values));
+        return *this;
+    }
+
+    // Swaps the elements, what std::iter_swap and so std::sort do with
+    // two dereferenced iterators.
+    friend void swap(ZipReference lhs, ZipReference rhs) {
+        lhs.swapElements(rhs, std::index_sequence_for<Refs...>());
+    }
+
+private:
+    template <std::size_t ...I>
+    void moveElements(ZipReference& other, std::index_sequence<I...>) {
+        (void) std::initializer_list<int> { (std::get<I>(*this) = std::move(std::get<I>(other)), 0)... };
+    }
+
+    template <std::size_t ...I>
+    void swapElements(ZipReference& other, std::index_sequence<I...>) {
+        using std::swap;
+        (void) std::initializer_list<int> { (swap(std::get<I>(*this), std::get<I>(other)), 0)... };
+    }
+};
+
+// A zip's value_type: a tuple of the elements, which takes them over from
+// an rvalue ZipReference rather than copying them, so that std::sort and
+// the like move rows around, and sort move-only columns.
+template <class ...Ts>
+class ZipValue : public std::tuple<Ts...> {
+public:
+    using std::tuple<Ts...>::tuple;
+
+    ZipValue() = default;
+    ZipValue(const ZipValue&) = default;
+    ZipValue(ZipValue&&) = default;
+    ZipValue& operator=(const ZipValue&) = default;
+    ZipValue& operator=(ZipValue&&) = default;
+
+    template <class ...Refs>
+    ZipValue(ZipReference<Refs...>&& row)
+            : ZipValue(std::move(row), std::index_sequence_for<Refs...>()) {}
+
+private:
+    template <class ...Refs, std::size_t ...I>
+    ZipValue(ZipReference<Refs...>&& row, std::index_sequence<I...>)
+            : std::tuple<Ts...>(std::move(std::get<I>(row))...) {}
+};
 
 template <unsigned N>
 struct IteratorTupleHelper {
@@ -61,8 +156,9 @@ public:
     }
 
     template <class ...T>
-    static auto iterValues(const std::tuple<T...> &iter) {
-        return std::tuple_cat(IteratorTupleHelper<N-1>::iterValues(subtuple<1>(iter)), std::tie(*std::get<N>(iter)));
+    static void decrement(std::tuple<T...> &iter) {
+        --std::get<N>(iter);
+        IteratorTupleHelper<N - 1>::decrement(iter);
     }
 };
 
@@ -80,8 +176,8 @@ public:
     }
 
     template <class ...T>
-    static auto iterValues(const std::tuple<T...> &iter) {
-        return std::tie(*std::get<0>(iter));
+    static void decrement(std::tuple<T...> &iter) {
+        --std::get<0>(iter);
     }
 };
 
@@ -96,64 +192,313 @@ void increment(std::tuple<T...> &iter) {
 }
 
 template <class ...T>
-auto getValues(const std::tuple<T...> &iter) {
-    return IteratorTupleHelper<std::tuple_size<std::tuple<T...>>::value - 1>::iterValues(iter);
+void decrement(std::tuple<T...> &iter) {
+    IteratorTupleHelper<std::tuple_size<std::tuple<T...>>::value - 1>::decrement(iter);
+}
+
+// Ends that line up with each other, so that a bidirectional zip can be
+// walked back from its end: the ranges are cut to the shortest one, with a
+// walk over them.
+template <class ...T, std::size_t ...I>
+std::tuple<T...> alignedEnds(const std::tuple<T...>& begins, const std::tuple<T...>& ends, std::index_sequence<I...>) {
+    const std::ptrdiff_t sizes[] = { std::distance(std::get<I>(begins), std::get<I>(ends))... };
+    const auto size = *std::min_element(std::begin(sizes), std::end(sizes));
+    return std::tuple<T...>(std::next(std::get<I>(begins), size)...);
 }
 
+template <class Reference, class ...T, std::size_t ...I>
+Reference getValues(const std::tuple<T...> &iter, std::index_sequence<I...>) {
+    return Reference(*std::get<I>(iter)...);
+}
+
+template <class Result, class ...T, std::size_t ...I>
+Result moveValues(const std::tuple<T...> &iter, std::index_sequence<I...>) {
+    return Result(std::move(*std::get<I>(iter))...);
+}
+
+template <class ...>
+struct voider {
+    using type = void;
+};
+
+// Containers whose elements are an array that data() points to, walked by
+// the zip with plain pointers rather than their iterators.
+template <class T, class = void>
+struct is_contiguous : std::false_type {};
+
+template <class T>
+struct is_contiguous<T, typename voider<decltype(std::declval<T&>().data())>::type>
+    : std::is_same<decltype(std::declval<T&>().data()), std::remove_reference_t<iterator_reference_t<T>>*> {};
+
+// what a zip walks a range with
+template <class T>
+using zip_cursor_t = std::conditional_t<is_contiguous<T>::value, std::remove_reference_t<iterator_reference_t<T>>*, iterator_type_decay_t<T>>;
+
+template <class T>
+auto firstOf(T& container, std::true_type) {
+    return container.data();
+}
+
+template <class T>
+auto firstOf(T& container, std::false_type) {
+    return std::begin(container);
+}
+
+template <class T>
+auto lastOf(T& container, std::true_type) {
+    return container.data() + (std::end(container) - std::begin(container));
+}
+
+template <class T>
+auto lastOf(T& container, std::false_type) {
+    return std::end(container);
+}
+
+// Position of a zip over ranges walked step by step: an iterator for each
+// of them, all moved on every step, and the zip ends with the first range
+// that does. The end holds the ranges' own ends, which is enough to stop
+// going forward; they are lined up, with a walk over the ranges, only when
+// a copy of it is first stepped back from.
+template <class ...T>
+class StepCursor {
+public:
+    static StepCursor first(const std::tuple<T...>& begins, const std::tuple<T...>&) {
+        return StepCursor { begins, begins, false };
+    }
+
+    static StepCursor last(const std::tuple<T...>& begins, const std::tuple<T...>& ends) {
+        return StepCursor { ends, begins, true };
+    }
+
+    template <class Reference>
+    Reference get() const {
+        return getValues<Reference>(current, std::index_sequence_for<T...>());
+    }
+
+    template <class Result>
+    Result move() const {
+        return moveValues<Result>(current, std::index_sequence_for<T...>());
+    }
+
+    void next() { increment(current); }
+
+    void previous() {
+        if (unaligned) {
+            current = alignedEnds(begins, current, std::index_sequence_for<T...>());
+            unaligned = false;
+        }
+        decrement(current);
+    }
+
+    bool equals(const StepCursor& other) const {
+        return is(current, other.current);
+    }
+
+private:
+    StepCursor(std::tuple<T...> current, std::tuple<T...> begins, bool unaligned)
+        : current { std::move(current) }
+        , begins { std::move(begins) }
+        , unaligned { unaligned } {}
+
+    std::tuple<T...> current;
+    // to line the ends up from
+    std::tuple<T...> begins;
+    bool unaligned;
+};
+
+// Position of a zip over random access ranges: where the ranges start and
+// one index into all of them, up to the length of the shortest, found once.
+// A step is one increment and the end is one comparison, so a loop over the
+// zip is an indexed loop to the compiler, and gets vectorized like one.
+template <class ...T>
+class IndexedCursor {
+public:
+    static IndexedCursor first(const std::tuple<T...>& begins, const std::tuple<T...>&) {
+        return IndexedCursor { begins, 0 };
+    }
+
+    static IndexedCursor last(const std::tuple<T...>& begins, const std::tuple<T...>& ends) {
+        return IndexedCursor { begins, length(begins, ends, std::index_sequence_for<T...>()) };
+    }
+
+    template <class Reference>
+    Reference get() const {
+        return get<Reference>(std::index_sequence_for<T...>());
+    }
+
+    template <class Result>
+    Result move() const {
+        return move<Result>(std::index_sequence_for<T...>());
+    }
+
+    void next() { ++index; }
+    void previous() { --index; }
+    void advance(std::ptrdiff_t n) { index += n; }
+
+    bool equals(const IndexedCursor& other) const {
+        return index == other.index;
+    }
+
+    std::ptrdiff_t distance(const IndexedCursor& other) const {
+        return index - other.index;
+    }
+
+private:
+    IndexedCursor(std::tuple<T...> bases, std::ptrdiff_t index)
+        : bases { std::move(bases) }
+        , index { index } {}
+
+    template <std::size_t ...I>
+    static std::ptrdiff_t length(const std::tuple<T...>& begins, const std::tuple<T...>& ends, std::index_sequence<I...>) {
+        const std::ptrdiff_t sizes[] = { (std::get<I>(ends) - std::get<I>(begins))... };
+        return *std::min_element(std::begin(sizes), std::end(sizes));
+    }
+
+    template <class Reference, std::size_t ...I>
+    Reference get(std::index_sequence<I...>) const {
+        return Reference(*(std::get<I>(bases) + index)...);
+    }
+
+    template <class Result, std::size_t ...I>
+    Result move(std::index_sequence<I...>) const {
+        return Result(std::move(*(std::get<I>(bases) + index))...);
+    }
+
+    std::tuple<T...> bases;
+    std::ptrdiff_t index;
+};
+
 template <typename ...Args>
 class ZipContainer {
+    using Cursor = std::conditional_t<
+            std::is_base_of<std::random_access_iterator_tag, zip_category_t<Args...>>::value,
+            IndexedCursor<zip_cursor_t<Args>...>,
+            StepCursor<zip_cursor_t<Args>...>>;
 public:
     class ZipIterator {
     public:
-        using value_type = std::tuple<value_type_decay_t<Args>...>;
-        using pointer_type = value_type*;
-        using reference_type = value_type&;
-        using iterator_category = std::forward_iterator_tag;
+        using value_type = ZipValue<value_type_decay_t<Args>...>;
+        using reference = ZipReference<iterator_reference_t<Args>...>;
+        // elements live in the containers, there is nothing to point to
+        using pointer = void;
+        using iterator_category = zip_category_t<Args...>;
         using difference_type = std::ptrdiff_t;
-        using pointer = pointer_type;
-        using reference = reference_type;
 
-        explicit ZipIterator(std::tuple<iterator_type_decay_t<Args>...> iter)
-                : current { std::move(iter) } {}
+        explicit ZipIterator(Cursor cursor)
+                : cursor { std::move(cursor) } {}
+
+        reference operator*() const {
+            return cursor.template get<reference>();
+        }
 
-        std::tuple<value_type_decay_t<Args>...> operator*() const {
-            return getValues(current);
+        // found by ADL, like std::ranges::iter_move: a tuple of rvalue
+        // references, the elements are moved from when it is converted
+        friend std::tuple<rvalue_reference_t<iterator_reference_t<Args>>...> iter_move(const ZipIterator& iter) {
+            return iter.cursor.template move<std::tuple<rvalue_reference_t<iterator_reference_t<Args>>...>>();
         }
 
         ZipIterator& operator++() {
-            increment(current);
+            cursor.next();
             return *this;
         }
 
         ZipIterator operator++(int) {
-            ZipIterator tmp { current };
-            increment(current);
+            ZipIterator tmp { cursor };
+            cursor.next();
             return tmp;
         }
 
-        bool operator==(const ZipIterator& other) {
-            return is(current, other.current);
+        bool operator==(const ZipIterator& other) const {
+            return cursor.equals(other.cursor);
         }
 
-        bool operator!=(const ZipIterator& other) {
-            return !is(current, other.current);
+        bool operator!=(const ZipIterator& other) const {
+            return !cursor.equals(other.cursor);
+        }
+
+        // bidirectional, all ranges are
+
+        ZipIterator& operator--() {
+            cursor.previous();
+            return *this;
+        }
+
+        ZipIterator operator--(int) {
+            ZipIterator tmp { cursor };
+            cursor.previous();
+            return tmp;
+        }
+
+        // random access, all ranges are
+
+        ZipIterator& operator+=(difference_type n) {
+            cursor.advance(n);
+            return *this;
+        }
+
+        ZipIterator& operator-=(difference_type n) {
+            cursor.advance(-n);
+            return *this;
+        }
+
+        ZipIterator operator+(difference_type n) const {
+            return ZipIterator(*this) += n;
+        }
+
+        friend ZipIterator operator+(difference_type n, const ZipIterator& iter) {
+            return iter + n;
+        }
+
+        ZipIterator operator-(difference_type n) const {
+            return ZipIterator(*this) -= n;
+        }
+
+        difference_type operator-(const ZipIterator& other) const {
+            return cursor.distance(other.cursor);
+        }
+
+        reference operator[](difference_type n) const {
+            return *(*this + n);
+        }
+
+        bool operator<(const ZipIterator& other) const {
+            return cursor.distance(other.cursor) < 0;
+        }
+
+        bool operator>(const ZipIterator& other) const {
+            return other < *this;
+        }
+
+        bool operator<=(const ZipIterator& other) const {
+            return !(other < *this);
+        }
+
+        bool operator>=(const ZipIterator& other) const {
+            return !(*this < other);
         }
 
     private:
-        std::tuple<iterator_type_decay_t<Args>...> current;
+        Cursor cursor;
     };
 public:
     explicit ZipContainer(Args&& ...containers)
-            : begins { std::make_tuple(std::begin(containers)...) }
-            , ends { std::make_tuple(std::end(containers)...) }
+            : ZipContainer(std::make_tuple(firstOf(containers, is_contiguous<Args>())...),
+                           std::make_tuple(lastOf(containers, is_contiguous<Args>())...))
     {}
 
-    ZipIterator begin() const { return ZipIterator(begins); }
-    ZipIterator end() const { return ZipIterator(ends); }
+    ZipIterator begin() const { return ZipIterator(first); }
+    ZipIterator end() const { return ZipIterator(last); }
+
+    // random access zips, the length of the shortest range
+    std::size_t size() const { return end() - begin(); }
 private:
-    std::tuple<iterator_type_decay_t<Args>...> begins;
-    std::tuple<iterator_type_decay_t<Args>...> ends;
+    ZipContainer(const std::tuple<zip_cursor_t<Args>...>& begins, const std::tuple<zip_cursor_t<Args>...>& ends)
+            : first { Cursor::first(begins, ends) }
+            , last { Cursor::last(begins, ends) }
+    {}
 
+    Cursor first;
+    Cursor last;
 };
 
 } // namespace __impl
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "growable_allocator.h"
+
+
+namespace {
+
+size_t roundUp(size_t value, size_t step) noexcept {
+    return (value + step - 1) / step * step;
+}
+
+void* mapAnonymous(size_t size, int flags) noexcept {
+    const auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+}
+
+constexpr size_t MmapArena::huge_page_size;
+
+MmapArena::MmapArena(size_t size, HugePages huge_pages, size_t release_threshold)
+    : page { static_cast<size_t>(sysconf(_SC_PAGESIZE)) }
+    , release_threshold { release_threshold } {
+#ifdef MAP_HUGETLB
+    if (huge_pages == HugePages::hugetlb) {
+        length = roundUp(size, huge_page_size);
+        start = static_cast<char*>(mapAnonymous(length, MAP_HUGETLB));
+        if (start != nullptr) {
+            page = huge_page_size;
+            return;
+        }
+    }
+#endif
+    if (huge_pages == HugePages::none) {
+        length = roundUp(size, page);
+        start = static_cast<char*>(mapAnonymous(length, 0));
+        if (start == nullptr) {
+            throw std::bad_alloc();
+        }
+        return;
+    }
+
+    // Huge pages need huge page aligned ranges: map one more, cut off the
+    // misaligned ends, and release whole huge pages only, so that they
+    // aren't split.
+    length = roundUp(size, huge_page_size);
+    const auto mapping = static_cast<char*>(mapAnonymous(length + huge_page_size, 0));
+    if (mapping == nullptr) {
+        throw std::bad_alloc();
+    }
+    start = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(mapping), huge_page_size));
+    if (start != mapping) {
+        munmap(mapping, start - mapping);
+    }
+    munmap(start + length, mapping + huge_page_size - start);
+    page = huge_page_size;
+#ifdef MADV_HUGEPAGE
+    madvise(start, length, MADV_HUGEPAGE);
+#endif
+}
+
+MmapArena::~MmapArena() {
+    munmap(start, length);
+}
+
+char* MmapArena::begin() noexcept {
+    return start;
+}
+
+size_t MmapArena::size() const noexcept {
+    return length;
+}
+
+size_t MmapArena::releaseThreshold() const noexcept {
+    return release_threshold == 0 ? 0 : std::max(release_threshold, page);
+}
+
+void MmapArena::release(char* begin, size_t size) noexcept {
+    const auto first = roundUp(reinterpret_cast<uintptr_t>(begin), page);
+    const auto last = (reinterpret_cast<uintptr_t>(begin) + size) / page * page;
+    if (first < last) {
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    }
+}
+
+size_t MmapArena::pageSize() const noexcept {
+    return page;
+}
+
+
+struct GrowableAllocator::Chunk {
+    Chunk(size_t size, const Options& options)
+        : arena { size, options.huge_pages, options.release_threshold }
+        , allocator { arena }
+    {}
+
+    MmapArena arena;
+    MergeAllocator allocator;
+};
+
+GrowableAllocator::GrowableAllocator()
+    : GrowableAllocator(Options {})
+{}
+
+GrowableAllocator::GrowableAllocator(const Options& options)
+    : options { options }
+{}
+
+GrowableAllocator::~GrowableAllocator() = default;
+
+char* GrowableAllocator::allocate(size_t size) noexcept {
+    if (size == 0) {
+        return nullptr;
+    }
+    if (current != nullptr) {
+        if (const auto ptr = current->allocator.allocate(size)) {
+            return ptr;
+        }
+    }
+    // chunks are large, so there are few of them to go through
+    for (const auto& chunk : chunks) {
+        if (chunk.get() == current) {
+            continue;
+        }
+        if (const auto ptr = chunk->allocator.allocate(size)) {
+            current = chunk.get();
+            return ptr;
+        }
+    }
+    const auto chunk = grow(size);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+    current = chunk;
+    return chunk->allocator.allocate(size);
+}
+
+void GrowableAllocator::deallocate(char* ptr, size_t size) noexcept {
+    const auto chunk = chunkOf(ptr);
+    assert(chunk != nullptr);
+    chunk->allocator.deallocate(ptr, size);
+}
+
+size_t GrowableAllocator::chunkCount() const noexcept {
+    return chunks.size();
+}
+
+GrowableAllocator::Chunk* GrowableAllocator::chunkOf(const char* ptr) const noexcept {
+    const auto after = std::upper_bound(chunks.begin(), chunks.end(), ptr, [](const char* ptr, const std::unique_ptr<Chunk>& chunk){
+        return ptr < chunk->arena.begin();
+    });
+    if (after == chunks.begin()) {
+        return nullptr;
+    }
+    const auto& chunk = *std::prev(after);
+    return ptr < chunk->arena.begin() + chunk->arena.size() ? chunk.get() : nullptr;
+}
+
+GrowableAllocator::Chunk* GrowableAllocator::grow(size_t size) noexcept {
+    try {
+        std::unique_ptr<Chunk> chunk(new Chunk(std::max(options.chunk_size, size), options));
+        const auto position = std::upper_bound(chunks.begin(), chunks.end(), chunk, [](const std::unique_ptr<Chunk>& lhs, const std::unique_ptr<Chunk>& rhs){
+            return lhs->arena.begin() < rhs->arena.begin();
+        });
+        return chunks.insert(position, std::move(chunk))->get();
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
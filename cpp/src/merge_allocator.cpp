@@ -2,120 +2,484 @@
 // Created by dilletante on 06.05.18.
 //
 #include <algorithm>
-#include <tuple>
 #include <cassert>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <utility>
 #include "merge_allocator.h"
 
 
+// Header of a free block, lives in its first granule. Links are granule
+// offsets from the beginning of the arena.
 struct Node {
-    size_t size;
-    Node* next;
+    uint32_t size;      // in granules
+    uint32_t next;      // same size class
+    uint32_t prev;
+    // granules that may have been written since the block was last offered
+    // back to the arena, at most size
+    uint32_t unreleased;
+};
+
+// Last granule of a free block longer than one granule: where it starts.
+struct Footer {
+    uint32_t start;
 };
 
 namespace {
 
-Node *createNodeIn(char *place, size_t size, Node *next = nullptr) noexcept {
-    assert(place != nullptr);
-    const auto node = reinterpret_cast<Node*>(place);
-    node->size = size;
-    node->next = next;
-    return node;
+constexpr size_t granule = sizeof(Node);
+static_assert(granule == 16, "free block header has to fill exactly one granule");
+
+constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+// so that no offset or size ever equals `none`
+constexpr size_t max_granules = none - 1;
+
+constexpr int own_class_probes = 4;
+
+size_t granulesFor(size_t size) noexcept {
+    return size / granule + (size % granule != 0 ? 1 : 0);
 }
 
-Node* mergeLeftAndReturnPrev(Node* right, char* block, size_t size) noexcept {
-    const auto right_block = reinterpret_cast<char*>(right);
-    const auto end = block + size;
-    assert(end <= right_block);
+unsigned highestBit(size_t value) noexcept {
+    assert(value != 0);
+    return 63 - __builtin_clzll(value);
+}
 
-    const auto left = right_block - end;
-    if (left < sizeof(Node)) {
-        return createNodeIn(block, right->size + size + left, right->next);
-    } else {
-        return createNodeIn(block, size, right);
-    }
+unsigned lowestBit(uint32_t value) noexcept {
+    assert(value != 0);
+    return __builtin_ctz(value);
+}
+
+bool testBit(const uint64_t* map, uint32_t index) noexcept {
+    return (map[index / 64] >> (index % 64)) & 1;
+}
+
+void setBit(uint64_t* map, uint32_t index) noexcept {
+    map[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+void clearBit(uint64_t* map, uint32_t index) noexcept {
+    map[index / 64] &= ~(uint64_t(1) << (index % 64));
+}
+
+// (first level, second level) of the class holding blocks of this size:
+// sizes below 16 granules get a class each, above that every power of two
+// is split into 16 equal ranges.
+struct SizeClass {
+    size_t first;
+    size_t second;
 };
 
-void mergeRight(Node* left, char* block, size_t size) noexcept {
-    const auto end = reinterpret_cast<char*>(left) + left->size;
-    assert(end <= block);
+template <unsigned SecondLevelBits>
+SizeClass classOf(size_t granules) noexcept {
+    constexpr size_t linear = size_t(1) << SecondLevelBits;
+    if (granules < linear) {
+        return SizeClass { 0, granules };
+    }
+    const auto msb = highestBit(granules);
+    return SizeClass {
+            msb - SecondLevelBits + 1,
+            (granules >> (msb - SecondLevelBits)) - linear
+    };
+}
 
-    const auto left_diff = block - end;
-    if (left_diff < sizeof(Node)) {
-        left->size += size + left_diff;
-        left->next = left->next ? left->next->next : nullptr;
+// granules whose bitmaps fit in a word each inside the allocator
+constexpr size_t inline_granules = 64;
+
+// How many granules fit in an arena of size bytes starting at begin, with
+// the two bitmaps, a bit per granule each, in 64 bit words after them
+// unless the arena is small enough for the inline ones.
+size_t granulesIn(char* begin, size_t size) noexcept {
+    if (size / granule <= inline_granules) {
+        return size / granule;
+    }
+    constexpr size_t group = 64 * granule + 2 * sizeof(uint64_t);
+    auto granules = std::min(size / group * 64 + size % group * 64 / group, max_granules);
+    const auto end = reinterpret_cast<uintptr_t>(begin) + size;
+    for (; granules > 0; --granules) {
+        const auto maps = (reinterpret_cast<uintptr_t>(begin) + granules * granule + alignof(uint64_t) - 1) & ~uintptr_t(alignof(uint64_t) - 1);
+        if (maps + 2 * sizeof(uint64_t) * ((granules + 63) / 64) <= end) {
+            break;
+        }
     }
+    return granules;
 }
 
-size_t padding(size_t size, size_t padding) {
-    const auto reminder = size % padding;
-    if (reminder > 0) {
-        size += padding - reminder;
+// unreleased granules of what is left of a free block once its start is
+// taken: those it had, and the header written at its new start
+uint32_t remainder(uint32_t unreleased, uint32_t size) noexcept {
+    return std::min(unreleased + 1, size);
+}
+
+// Smallest size such that every block of its class is at least `granules`.
+template <unsigned SecondLevelBits>
+size_t roundUpToClass(size_t granules) noexcept {
+    if (granules < (size_t(1) << SecondLevelBits)) {
+        return granules;
     }
-    return size;
+    const auto step = size_t(1) << (highestBit(granules) - SecondLevelBits);
+    return (granules + step - 1) & ~(step - 1);
 }
 
 }
 
+constexpr size_t MergeAllocatorStats::size_buckets;
+
+constexpr unsigned MergeAllocator::second_level_bits;
+constexpr size_t MergeAllocator::second_levels;
+constexpr size_t MergeAllocator::first_levels;
+
 MergeAllocator::MergeAllocator(ArenaHolder& holder) noexcept
     : holder { holder }
-    , head { createNodeIn(holder.begin(), holder.size()) } {
-    assert(holder.size() >= sizeof(Node));
+    , begin { holder.begin() }
+    , granules { static_cast<uint32_t>(std::min(holder.size() / granule, max_granules)) }
+    // a released block keeps its header and footer granules
+    , release_threshold { holder.releaseThreshold() == 0 ? 0 : std::max<size_t>(granulesFor(holder.releaseThreshold()) + 2, 3) } {
+    assert(granules > 0);
+    for (auto& lists : free_lists) {
+        std::fill(std::begin(lists), std::end(lists), none);
+    }
+    if (granules <= inline_granules) {
+        free_starts = &inline_maps[0];
+        free_ends = &inline_maps[1];
+    } else {
+        metadata_size = 2 * sizeof(uint64_t) * ((size_t(granules) + 63) / 64);
+        metadata = holder.allocateMetadata(metadata_size);
+        if (metadata != nullptr) {
+            free_starts = static_cast<uint64_t*>(metadata);
+        } else {
+            // the end of the arena, after the last granule
+            granules = static_cast<uint32_t>(granulesIn(begin, holder.size()));
+            free_starts = reinterpret_cast<uint64_t*>((reinterpret_cast<uintptr_t>(begin) + size_t(granules) * granule + alignof(uint64_t) - 1) & ~uintptr_t(alignof(uint64_t) - 1));
+        }
+        const size_t words = (size_t(granules) + 63) / 64;
+        free_ends = free_starts + words;
+        std::fill(free_starts, free_ends + words, 0);
+    }
+    const auto whole = node(0);
+    whole->size = granules;
+    whole->unreleased = granules;
+    insert(whole);
+}
+
+MergeAllocator::~MergeAllocator() {
+    if (metadata != nullptr) {
+        holder.deallocateMetadata(metadata, metadata_size);
+    }
 }
 
 char* MergeAllocator::allocate(size_t size) noexcept {
     if (size == 0) {
         return nullptr;
     }
-    // we can allocate only fold of sizeof(Node) space
-    size = padding(size, sizeof(Node));
-
-    Node* best_candidate = nullptr;
-    Node* prev_of_best = nullptr;
-    for (Node *iter = head, *prev = nullptr; iter != nullptr; prev = iter, iter = iter->next) {
-        if (iter->size >= size && (best_candidate == nullptr || iter->size < best_candidate->size)) {
-            best_candidate = iter;
-            prev_of_best = prev;
-            if (best_candidate->size == size) {
-                break;
-            }
+    ++allocations;
+    const auto wanted = granulesFor(size);
+    const auto block = find(wanted);
+    if (block == nullptr) {
+        ++failed_allocations;
+        return nullptr;
+    }
+
+    remove(block);
+    if (block->size > wanted) {
+        const auto rest = node(offset(block) + static_cast<uint32_t>(wanted));
+        rest->size = static_cast<uint32_t>(block->size - wanted);
+        rest->unreleased = remainder(block->unreleased, rest->size);
+        insert(rest);
+    }
+    return reinterpret_cast<char*>(block);
+}
+
+void MergeAllocator::deallocate(char* ptr, size_t size) noexcept {
+    assert(ptr >= begin && ptr + size <= begin + size_t(granules) * granule);
+    const auto block = reinterpret_cast<Node*>(ptr);
+    block->size = static_cast<uint32_t>(granulesFor(size));
+    ++deallocations;
+    free(block);
+}
+
+char* MergeAllocator::allocateAligned(size_t size, size_t alignment) noexcept {
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment <= this->alignment()) {
+        return allocate(size);
+    }
+    if (size == 0 || this->alignment() < granule) {
+        return nullptr;
+    }
+    ++allocations;
+    const auto wanted = granulesFor(size);
+    const auto padding = [alignment](const Node* block) {
+        const auto address = reinterpret_cast<uintptr_t>(block);
+        return ((address + alignment - 1) / alignment * alignment - address) / granule;
+    };
+    // the block found for the size alone may happen to have room, else
+    // one with room for the worst case padding
+    auto block = find(wanted);
+    if (block == nullptr || block->size < padding(block) + wanted) {
+        const auto worst = alignment / granule - 1;
+        block = wanted <= max_granules && worst <= max_granules - wanted ? find(wanted + worst) : nullptr;
+        if (block == nullptr) {
+            ++failed_allocations;
+            return nullptr;
+        }
+    }
+
+    remove(block);
+    const auto lead = padding(block);
+    const auto start = offset(block) + static_cast<uint32_t>(lead);
+    const auto rest = block->size - lead - wanted;
+    const auto unreleased = block->unreleased;
+    if (lead != 0) {
+        // stays a free block of its own: what is left of it isn't free,
+        // so there is nothing to merge with
+        block->size = static_cast<uint32_t>(lead);
+        block->unreleased = std::min(unreleased, block->size);
+        insert(block);
+    }
+    if (rest != 0) {
+        const auto tail = node(start + static_cast<uint32_t>(wanted));
+        tail->size = static_cast<uint32_t>(rest);
+        tail->unreleased = remainder(unreleased, tail->size);
+        insert(tail);
+    }
+    return reinterpret_cast<char*>(node(start));
+}
+
+char* MergeAllocator::reallocate(char* ptr, size_t old_size, size_t new_size) noexcept {
+    if (ptr == nullptr) {
+        return allocate(new_size);
+    }
+    if (new_size == 0) {
+        deallocate(ptr, old_size);
+        return nullptr;
+    }
+    ++reallocations;
+    const auto start = offset(reinterpret_cast<Node*>(ptr));
+    const auto old_granules = granulesFor(old_size);
+    const auto new_granules = granulesFor(new_size);
+    if (new_granules == old_granules) {
+        return ptr;
+    }
+    if (new_granules < old_granules) {
+        const auto tail = node(start + static_cast<uint32_t>(new_granules));
+        tail->size = static_cast<uint32_t>(old_granules - new_granules);
+        free(tail);
+        return ptr;
+    }
+
+    const auto right = rightNeighbour(start + static_cast<uint32_t>(old_granules));
+    if (right != nullptr && old_granules + right->size >= new_granules) {
+        const auto rest = old_granules + right->size - new_granules;
+        remove(right);
+        if (rest != 0) {
+            const auto tail = node(start + static_cast<uint32_t>(new_granules));
+            tail->size = static_cast<uint32_t>(rest);
+            tail->unreleased = remainder(right->unreleased, tail->size);
+            insert(tail);
         }
+        return ptr;
     }
 
-    if (best_candidate != nullptr) {
-        const auto allocated_space = reinterpret_cast<char*>(best_candidate);
-        const auto left = best_candidate->size - size;
-        const auto new_node = left >= sizeof(Node) ?
-                        createNodeIn(allocated_space + size, left, best_candidate->next) :
-                        best_candidate->next;
-        (prev_of_best != nullptr ? prev_of_best->next : head) = new_node;
-        return allocated_space;
+    const auto moved = allocate(new_size);
+    if (moved == nullptr) {
+        return nullptr;
     }
+    std::memcpy(moved, ptr, old_size);
+    deallocate(ptr, old_size);
+    return moved;
+}
 
-    return nullptr;
+size_t MergeAllocator::alignment() const noexcept {
+    const auto address = reinterpret_cast<uintptr_t>(begin);
+    return std::min<size_t>(granule, address & (~address + 1));
 }
 
-void MergeAllocator::deallocate(char* ptr, size_t size) noexcept {
-    // we can allocate only fold of sizeof(Node) space
-    size = padding(size, sizeof(Node));
-
-    const auto end = ptr + size;
-    Node* prev = nullptr;
-    for (auto iter = head; iter != nullptr; prev = iter, iter = iter->next) {
-        if (reinterpret_cast<char*>(iter) >= end) {
-            if (prev != nullptr) {
-                prev->next = mergeLeftAndReturnPrev(iter, ptr, size);
-                mergeRight(prev, reinterpret_cast<char*>(prev->next), prev->next->size);
-            } else {
-                head = mergeLeftAndReturnPrev(iter, ptr, size);
+MergeAllocatorStats MergeAllocator::stats() const noexcept {
+    MergeAllocatorStats stats;
+    stats.arena_bytes = size_t(granules) * granule;
+    stats.free_bytes = free_granules * granule;
+    stats.used_bytes = stats.arena_bytes - stats.free_bytes;
+    for (size_t i = 0; i < MergeAllocatorStats::size_buckets; ++i) {
+        stats.free_blocks_by_size[i] = free_blocks_by_size[i];
+        stats.free_blocks += free_blocks_by_size[i];
+    }
+    if (first_level_map != 0) {
+        // somewhere in the list of the biggest class
+        const auto first = highestBit(first_level_map);
+        const auto second = highestBit(second_level_maps[first]);
+        for (auto i = free_lists[first][second]; i != none; i = node(i)->next) {
+            stats.largest_free_block = std::max(stats.largest_free_block, node(i)->size * granule);
+        }
+        stats.fragmentation = 1 - double(stats.largest_free_block) / stats.free_bytes;
+    }
+    stats.allocations = allocations;
+    stats.failed_allocations = failed_allocations;
+    stats.deallocations = deallocations;
+    stats.reallocations = reallocations;
+    stats.visited_nodes = visited_nodes;
+    return stats;
+}
+
+void MergeAllocator::walk(const std::function<void(const HeapBlock&)>& visit) const {
+    uint32_t position = 0;
+    const size_t words = (size_t(granules) + 63) / 64;
+    for (size_t word = 0; word < words; ++word) {
+        for (auto bits = free_starts[word]; bits != 0; bits &= bits - 1) {
+            const auto start = static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+            const auto size = node(start)->size;
+            if (start > position) {
+                visit(HeapBlock { begin + size_t(position) * granule, size_t(start - position) * granule, false });
             }
-            return;
+            visit(HeapBlock { begin + size_t(start) * granule, size * granule, true });
+            position = start + static_cast<uint32_t>(size);
         }
     }
+    if (position < granules) {
+        visit(HeapBlock { begin + size_t(position) * granule, size_t(granules - position) * granule, false });
+    }
+}
+
+Node* MergeAllocator::node(uint32_t offset) const noexcept {
+    assert(offset < granules);
+    return reinterpret_cast<Node*>(begin + size_t(offset) * granule);
+}
 
-    if (prev != nullptr) {
-        mergeRight(prev, ptr, size);
+uint32_t MergeAllocator::offset(const Node* node) const noexcept {
+    return static_cast<uint32_t>((reinterpret_cast<const char*>(node) - begin) / granule);
+}
+
+void MergeAllocator::insert(Node* node) noexcept {
+    const auto size_class = classOf<second_level_bits>(node->size);
+    auto& head = free_lists[size_class.first][size_class.second];
+    node->prev = none;
+    node->next = head;
+    if (head != none) {
+        this->node(head)->prev = offset(node);
+    }
+    head = offset(node);
+    const auto start = offset(node);
+    const auto last = start + static_cast<uint32_t>(node->size) - 1;
+    setBit(free_starts, start);
+    setBit(free_ends, last);
+    if (last != start) {
+        reinterpret_cast<Footer*>(this->node(last))->start = start;
+    }
+    first_level_map |= 1u << size_class.first;
+    second_level_maps[size_class.first] |= 1u << size_class.second;
+    free_granules += node->size;
+    ++free_blocks_by_size[highestBit(node->size)];
+}
+
+void MergeAllocator::remove(Node* node) noexcept {
+    const auto size_class = classOf<second_level_bits>(node->size);
+    auto& head = free_lists[size_class.first][size_class.second];
+    if (node->prev != none) {
+        this->node(node->prev)->next = node->next;
     } else {
-        head = createNodeIn(ptr, size);
+        head = node->next;
+    }
+    if (node->next != none) {
+        this->node(node->next)->prev = node->prev;
+    }
+    clearBit(free_starts, offset(node));
+    clearBit(free_ends, offset(node) + static_cast<uint32_t>(node->size) - 1);
+    free_granules -= node->size;
+    --free_blocks_by_size[highestBit(node->size)];
+    if (head == none) {
+        second_level_maps[size_class.first] &= ~(1u << size_class.second);
+        if (second_level_maps[size_class.first] == 0) {
+            first_level_map &= ~(1u << size_class.first);
+        }
     }
 }
 
+Node* MergeAllocator::find(size_t wanted) const noexcept {
+    // The class of the request itself may hold blocks that fit too; look
+    // at the first few before settling for a bigger class, it keeps
+    // fragmentation close to best fit and the cost bounded.
+    const auto own = classOf<second_level_bits>(std::min(wanted, max_granules));
+    auto candidate = free_lists[own.first][own.second];
+    for (int i = 0; i < own_class_probes && candidate != none; ++i, candidate = node(candidate)->next) {
+        ++visited_nodes;
+        if (node(candidate)->size >= wanted) {
+            return node(candidate);
+        }
+    }
+
+    const auto rounded = roundUpToClass<second_level_bits>(wanted);
+    if (rounded > max_granules) {
+        return nullptr;
+    }
+    const auto size_class = classOf<second_level_bits>(rounded);
+
+    auto first = size_class.first;
+    auto second_map = second_level_maps[first] & (~0u << size_class.second);
+    if (second_map == 0) {
+        const auto first_map = first + 1 < first_levels ? first_level_map & (~0u << (first + 1)) : 0;
+        if (first_map == 0) {
+            return nullptr;
+        }
+        first = lowestBit(first_map);
+        second_map = second_level_maps[first];
+    }
+    ++visited_nodes;
+    return node(free_lists[first][lowestBit(second_map)]);
+}
+
+// Puts the block back, merged with its free neighbours, and offers it to
+// the arena if it is big enough. Only once as much as the threshold was
+// freed into it since the last offer: a small block going back and forth
+// next to a released one doesn't make a call each time.
+void MergeAllocator::free(Node* block) noexcept {
+    block->unreleased = block->size;
+    const auto merged = coalesce(block);
+    if (release_threshold != 0 && merged->size >= release_threshold && merged->unreleased + 2 >= release_threshold) {
+        holder.release(reinterpret_cast<char*>(merged) + granule, (merged->size - 2) * granule);
+        merged->unreleased = 0;
+    }
+    insert(merged);
+}
+
+// Merges the block with free blocks right before and after it, which are
+// taken out of the index; returns the start of the merged block.
+Node* MergeAllocator::coalesce(Node* block) noexcept {
+    const auto start = offset(block);
+    const auto right = rightNeighbour(start + static_cast<uint32_t>(block->size));
+    const auto left = leftNeighbour(start);
+
+    // the granules where the blocks meet were kept and count as written
+    if (right != nullptr) {
+        remove(right);
+        block->size += right->size;
+        block->unreleased = std::min(block->unreleased + right->unreleased + 1, block->size);
+    }
+    if (left != nullptr) {
+        remove(left);
+        left->size += block->size;
+        left->unreleased = std::min(left->unreleased + block->unreleased + 1, left->size);
+        block = left;
+    }
+    return block;
+}
+
+// free block ending right before granule `start`
+Node* MergeAllocator::leftNeighbour(uint32_t start) const noexcept {
+    if (start == 0) {
+        return nullptr;
+    }
+    const auto last = start - 1;
+    if (!testBit(free_ends, last)) {
+        return nullptr;
+    }
+    // a single granule block has no room for a footer
+    return node(testBit(free_starts, last) ? last : reinterpret_cast<const Footer*>(node(last))->start);
+}
+
+// free block starting at granule `end`
+Node* MergeAllocator::rightNeighbour(uint32_t end) const noexcept {
+    if (end >= granules) {
+        return nullptr;
+    }
+    return testBit(free_starts, end) ? node(end) : nullptr;
+}
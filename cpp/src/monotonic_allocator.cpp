@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include "monotonic_allocator.h"
+
+
+// In front of an allocation that overflowed to the fallback.
+struct MonotonicAllocator::Overflow {
+    Overflow* previous;
+    size_t size;        // of the whole block
+};
+
+namespace {
+
+constexpr size_t header_size = 16;
+static_assert(sizeof(MonotonicAllocator::Overflow) <= header_size, "overflow header has to fit in front of 16 byte aligned data");
+
+bool isPowerOfTwo(size_t value) noexcept {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+}
+
+MonotonicAllocator::MonotonicAllocator(ArenaHolder& holder, MergeAllocator& fallback) noexcept
+    : begin { holder.begin() }
+    , end { holder.begin() + holder.size() }
+    , top { begin }
+    , fallback { fallback }
+{}
+
+MonotonicAllocator::~MonotonicAllocator() {
+    reset();
+}
+
+char* MonotonicAllocator::allocate(size_t size, size_t alignment) noexcept {
+    assert(isPowerOfTwo(alignment));
+    const auto address = reinterpret_cast<uintptr_t>(top);
+    const size_t padding = (address + alignment - 1) / alignment * alignment - address;
+    const size_t left = end - top;
+    if (padding <= left && size <= left - padding) {
+        const auto aligned = top + padding;
+        top = aligned + size;
+        return aligned;
+    }
+
+    // the data follows the header, aligned as the block
+    const auto offset = std::max(header_size, alignment);
+    if (size > SIZE_MAX - offset) {
+        return nullptr;
+    }
+    const auto block = fallback.allocateAligned(offset + size, alignment);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    overflow = new (block) Overflow { overflow, offset + size };
+    return block + offset;
+}
+
+char* MonotonicAllocator::allocateLasting(size_t size, size_t alignment) noexcept {
+    return fallback.allocateAligned(size, alignment);
+}
+
+void MonotonicAllocator::deallocateLasting(char* ptr, size_t size) noexcept {
+    fallback.deallocate(ptr, size);
+}
+
+MonotonicAllocator::Checkpoint MonotonicAllocator::checkpoint() const noexcept {
+    return Checkpoint { top, overflow };
+}
+
+void MonotonicAllocator::rewind(const Checkpoint& checkpoint) noexcept {
+    assert(checkpoint.top >= begin && checkpoint.top <= top);
+    top = checkpoint.top;
+    while (overflow != checkpoint.overflow) {
+        assert(overflow != nullptr);
+        const auto block = overflow;
+        overflow = block->previous;
+        fallback.deallocate(reinterpret_cast<char*>(block), block->size);
+    }
+}
+
+void MonotonicAllocator::reset() noexcept {
+    rewind(Checkpoint { begin, nullptr });
+}
+
+size_t MonotonicAllocator::used() const noexcept {
+    return top - begin;
+}
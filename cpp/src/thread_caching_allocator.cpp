@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "thread_caching_allocator.h"
+
+
+namespace {
+
+constexpr size_t granule = 16;
+
+// block sizes of the cached classes, in granules
+constexpr size_t class_granules[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64 };
+constexpr size_t classes = sizeof(class_granules) / sizeof(class_granules[0]);
+
+// empty runs a cache collects before giving them back in one go
+constexpr size_t release_batch = 8;
+
+struct ClassTable {
+    ClassTable() noexcept {
+        size_t size_class = 0;
+        for (size_t granules = 1; granules < sizeof(of) / sizeof(of[0]); ++granules) {
+            while (class_granules[size_class] < granules) {
+                ++size_class;
+            }
+            of[granules] = static_cast<uint8_t>(size_class);
+        }
+    }
+
+    uint8_t of[ThreadCachingAllocator::max_cached_size / granule + 1] = {};
+};
+
+size_t classOf(size_t size) noexcept {
+    static const ClassTable table;
+    return table.of[(size + granule - 1) / granule];
+}
+
+size_t blockSize(size_t size_class) noexcept {
+    return class_granules[size_class] * granule;
+}
+
+}
+
+constexpr size_t ThreadCachingAllocator::run_size;
+constexpr size_t ThreadCachingAllocator::max_cached_size;
+
+struct ThreadCachingAllocator::FreeBlock {
+    FreeBlock* next;
+};
+
+struct ThreadCachingAllocator::Run {
+    // read by threads freeing into the run, the rest is the owner's
+    std::atomic<Cache*> owner { nullptr };
+    FreeBlock* free = nullptr;
+    size_t used = 0;
+    size_t size_class = 0;
+    // in the owner's list of runs of this class with free blocks
+    Run* prev = nullptr;
+    Run* next = nullptr;
+    bool listed = false;
+};
+
+struct ThreadCachingAllocator::Cache {
+    // allocation takes from the first run
+    Run* partial[classes] = {};
+    // blocks of this cache's runs freed by other threads
+    std::atomic<FreeBlock*> returned { nullptr };
+    Run* empty[release_batch] = {};
+    size_t empty_count = 0;
+};
+
+struct ThreadCachingAllocator::Shared {
+    explicit Shared(ArenaHolder& holder)
+        : central { holder }
+        , begin { holder.begin() }
+        , runs { new Run[holder.size() / run_size] }
+    {}
+
+    Run* runOf(const void* ptr) noexcept {
+        return &runs[(static_cast<const char*>(ptr) - begin) / run_size];
+    }
+
+    char* startOf(const Run* run) noexcept {
+        return begin + (run - runs.get()) * run_size;
+    }
+
+    Cache* acquire() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!idle.empty()) {
+            const auto cache = idle.back();
+            idle.pop_back();
+            return cache;
+        }
+        std::unique_ptr<Cache> cache(new Cache);
+        // so that release() has room for every cache
+        idle.reserve(caches.size() + 1);
+        caches.push_back(std::move(cache));
+        return caches.back().get();
+    }
+
+    // the cache's thread exited, a new thread may adopt it
+    void release(Cache* cache) noexcept {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!alive.load(std::memory_order_relaxed)) {
+            return;
+        }
+        releaseEmptyRuns(*cache);
+        idle.push_back(cache);
+    }
+
+    // under the lock
+    void releaseEmptyRuns(Cache& cache) noexcept {
+        for (size_t i = 0; i < cache.empty_count; ++i) {
+            cache.empty[i]->owner.store(nullptr, std::memory_order_relaxed);
+            central.deallocate(startOf(cache.empty[i]), run_size);
+        }
+        cache.empty_count = 0;
+    }
+
+    std::mutex mutex;
+    MergeAllocator central;
+    char* const begin;
+    // one per run sized slot of the arena
+    const std::unique_ptr<Run[]> runs;
+    std::vector<std::unique_ptr<Cache>> caches;
+    std::vector<Cache*> idle;
+    // cleared under the lock when the allocator goes, read without it by
+    // threads dropping their leases
+    std::atomic<bool> alive { true };
+};
+
+struct ThreadCachingAllocator::Lease {
+    std::shared_ptr<Shared> shared;
+    Cache* cache;
+};
+
+// The caches a thread took, returned to their allocators when it exits.
+// A lease keeps the shared part alive in case the allocator went first;
+// leases of allocators that are gone are dropped on the next miss.
+struct ThreadCachingAllocator::Leases {
+    Leases() noexcept {
+        current = this;
+    }
+
+    ~Leases() {
+        current = nullptr;
+        finished = true;
+        last = nullptr;
+        last_cache = nullptr;
+        for (auto& lease : list) {
+            lease.shared->release(lease.cache);
+        }
+    }
+
+    void prune() noexcept {
+        list.erase(std::remove_if(list.begin(), list.end(), [](const Lease& lease) {
+            return !lease.shared->alive.load(std::memory_order_acquire);
+        }), list.end());
+        last = nullptr;
+        last_cache = nullptr;
+    }
+
+    std::vector<Lease> list;
+    // the lease found last, most threads use a single allocator
+    const Shared* last = nullptr;
+    Cache* last_cache = nullptr;
+
+    // this thread's leases, null before they are made and once they are
+    // destroyed; a plain pointer stays readable until the thread is gone
+    static thread_local Leases* current;
+    // Set once they are destroyed: the thread is exiting, and the caches
+    // it had may be another thread's already. Calls from thread_local
+    // destructors that run after that get no cache.
+    static thread_local bool finished;
+};
+
+thread_local ThreadCachingAllocator::Leases* ThreadCachingAllocator::Leases::current = nullptr;
+thread_local bool ThreadCachingAllocator::Leases::finished = false;
+
+namespace {
+
+template <class Run, class Cache>
+void list(Cache& cache, Run* run) noexcept {
+    auto& head = cache.partial[run->size_class];
+    run->prev = nullptr;
+    run->next = head;
+    if (head != nullptr) {
+        head->prev = run;
+    }
+    head = run;
+    run->listed = true;
+}
+
+template <class Run, class Cache>
+void unlist(Cache& cache, Run* run) noexcept {
+    if (run->prev != nullptr) {
+        run->prev->next = run->next;
+    } else {
+        cache.partial[run->size_class] = run->next;
+    }
+    if (run->next != nullptr) {
+        run->next->prev = run->prev;
+    }
+    run->prev = run->next = nullptr;
+    run->listed = false;
+}
+
+}
+
+ThreadCachingAllocator::ThreadCachingAllocator(ArenaHolder& holder)
+    : shared { std::make_shared<Shared>(holder) } {}
+
+ThreadCachingAllocator::~ThreadCachingAllocator() {
+    {
+        std::lock_guard<std::mutex> guard(shared->mutex);
+        shared->alive.store(false, std::memory_order_release);
+    }
+    // other threads drop theirs when they next miss
+    if (Leases::current != nullptr) {
+        Leases::current->prune();
+    }
+}
+
+ThreadCachingAllocator::Cache* ThreadCachingAllocator::cache() noexcept {
+    if (Leases::finished) {
+        return nullptr;
+    }
+    static thread_local Leases leases;
+
+    if (leases.last == shared.get()) {
+        return leases.last_cache;
+    }
+    Cache* cache = nullptr;
+    for (const auto& lease : leases.list) {
+        if (lease.shared == shared) {
+            cache = lease.cache;
+            break;
+        }
+    }
+    if (cache == nullptr) {
+        leases.prune();
+        try {
+            if (leases.list.size() == leases.list.capacity()) {
+                leases.list.reserve(std::max<size_t>(4, 2 * leases.list.size()));
+            }
+            cache = shared->acquire();
+        } catch (...) {
+            return nullptr;
+        }
+        // there is room for it
+        leases.list.push_back(Lease { shared, cache });
+    }
+    leases.last = shared.get();
+    leases.last_cache = cache;
+    return cache;
+}
+
+char* ThreadCachingAllocator::allocate(size_t size) noexcept {
+    if (size == 0) {
+        return nullptr;
+    }
+    if (size > max_cached_size) {
+        std::lock_guard<std::mutex> guard(shared->mutex);
+        return shared->central.allocate(size);
+    }
+
+    const auto local = cache();
+    if (local == nullptr) {
+        return nullptr;
+    }
+    auto& cache = *local;
+    const auto size_class = classOf(size);
+    auto run = cache.partial[size_class];
+    if (run == nullptr) {
+        // take back what other threads freed
+        auto block = cache.returned.exchange(nullptr, std::memory_order_acquire);
+        while (block != nullptr) {
+            const auto next = block->next;
+            freeLocal(cache, shared->runOf(block), block);
+            block = next;
+        }
+        run = cache.partial[size_class];
+    }
+    if (run == nullptr) {
+        run = newRun(cache, size_class);
+        if (run == nullptr) {
+            return nullptr;
+        }
+    }
+
+    const auto block = run->free;
+    run->free = block->next;
+    ++run->used;
+    if (run->free == nullptr) {
+        unlist(cache, run);
+    }
+    return reinterpret_cast<char*>(block);
+}
+
+void ThreadCachingAllocator::deallocate(char* ptr, size_t size) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (size > max_cached_size) {
+        std::lock_guard<std::mutex> guard(shared->mutex);
+        shared->central.deallocate(ptr, size);
+        return;
+    }
+
+    // without a cache of its own the thread frees like a foreign one
+    const auto cache = this->cache();
+    const auto run = shared->runOf(ptr);
+    const auto block = reinterpret_cast<FreeBlock*>(ptr);
+    const auto owner = run->owner.load(std::memory_order_acquire);
+    assert(owner != nullptr && "not a block of this allocator");
+    if (owner == cache) {
+        freeLocal(*cache, run, block);
+        return;
+    }
+    auto& returned = owner->returned;
+    auto head = returned.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void ThreadCachingAllocator::freeLocal(Cache& cache, Run* run, FreeBlock* block) noexcept {
+    block->next = run->free;
+    run->free = block;
+    --run->used;
+    if (!run->listed) {
+        list(cache, run);
+    }
+    // keep one run per class around, hand the others back once empty
+    if (run->used == 0 && (run->prev != nullptr || run->next != nullptr)) {
+        unlist(cache, run);
+        cache.empty[cache.empty_count++] = run;
+        if (cache.empty_count == release_batch) {
+            std::lock_guard<std::mutex> guard(shared->mutex);
+            shared->releaseEmptyRuns(cache);
+        }
+    }
+}
+
+ThreadCachingAllocator::Run* ThreadCachingAllocator::newRun(Cache& cache, size_t size_class) noexcept {
+    Run* run = nullptr;
+    if (cache.empty_count > 0) {
+        run = cache.empty[--cache.empty_count];
+    } else {
+        std::lock_guard<std::mutex> guard(shared->mutex);
+        // runs are aligned to their size from the arena's beginning so
+        // that any block finds its run by division; cut off the slack
+        const auto length = 2 * run_size - granule;
+        const auto raw = shared->central.allocate(length);
+        if (raw == nullptr) {
+            return nullptr;
+        }
+        const auto offset = static_cast<size_t>(raw - shared->begin);
+        const auto start = shared->begin + (offset + run_size - 1) / run_size * run_size;
+        if (start != raw) {
+            shared->central.deallocate(raw, start - raw);
+        }
+        if (start + run_size != raw + length) {
+            shared->central.deallocate(start + run_size, raw + length - (start + run_size));
+        }
+        run = shared->runOf(start);
+        run->owner.store(&cache, std::memory_order_release);
+    }
+
+    // blocks in address order
+    const auto start = shared->startOf(run);
+    const auto block_size = blockSize(size_class);
+    FreeBlock* free = nullptr;
+    for (auto offset = (run_size / block_size) * block_size; offset > 0; offset -= block_size) {
+        const auto block = reinterpret_cast<FreeBlock*>(start + offset - block_size);
+        block->next = free;
+        free = block;
+    }
+    run->free = free;
+    run->used = 0;
+    run->size_class = size_class;
+    list(cache, run);
+    return run;
+}
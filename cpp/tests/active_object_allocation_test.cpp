@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <thread>
+
+#include "active_object.h"
+
+// Replaces the global operator new to count allocations, which is why
+// these tests have an executable of their own.
+
+namespace {
+
+std::atomic<size_t> heap_allocations { 0 };
+
+} // namespace
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+TEST(ActiveObjectTest, asyncWithSmallCaptureDoesNotAllocate) {
+    class Sink {
+    public:
+        void put(int value) { sum += value; }
+        void hold(std::shared_future<void> gate) { gate.wait(); }
+    private:
+        long sum = 0;
+    };
+
+    constexpr int burst = 1000;
+
+    utils::ActiveObject<Sink> sink;
+    std::atomic<int> done { 0 };
+    auto post_burst = [&sink, &done](){
+        for (int i = 0; i < burst; ++i) {
+            sink.async([&done](){ done.fetch_add(1); }, &Sink::put, int(i));
+        }
+    };
+    auto wait_for = [&done](int expected){
+        while (done.load() != expected) {
+            std::this_thread::yield();
+        }
+    };
+
+    // grow both of the queue's ring buffers to hold a whole burst
+    for (int round = 1; round <= 2; ++round) {
+        std::promise<void> gate;
+        sink.async([&done](){ done.fetch_add(1); }, &Sink::hold, gate.get_future().share());
+        post_burst();
+        gate.set_value();
+        wait_for(round * (burst + 1));
+    }
+
+    const auto before = heap_allocations.load();
+    post_burst();
+    wait_for(2 * (burst + 1) + burst);
+    const auto after = heap_allocations.load();
+
+    ASSERT_EQ(after - before, 0u);
+}
@@ -3,6 +3,11 @@
 #include <iostream>
 #include <thread>
 #include <future>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include <atomic>
 
 #include "active_object.h"
 
@@ -62,4 +67,397 @@ TEST(ActiveObjectTest, testWithA) {
     aa.async([](char a){
         std::cout << std::this_thread::get_id() << " result " << a << std::endl;
     }, &A::getChar, 'd', 3);
-}
\ No newline at end of file
+}
+
+TEST(ActiveObjectTest, activeObjectWithMpscQueueUnderManyProducers) {
+    class Counter {
+    public:
+        void add(int value) { sum += value; }
+        long get() { return sum; }
+    private:
+        long sum = 0;
+    };
+
+    constexpr int producers = 16;
+    constexpr int per_producer = 5000;
+
+    utils::ActiveObject<Counter, utils::MpscQueue> counter;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&counter](){
+            for (int i = 0; i < per_producer; ++i) {
+                counter.async([](){}, &Counter::add, 1);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(counter.sync(&Counter::get), producers * per_producer);
+}
+
+TEST(ActiveObjectTest, batchDrainingKeepsFifoOrder) {
+    class Log {
+    public:
+        void append(int value) { values.push_back(value); }
+        std::vector<int> get() { return values; }
+    private:
+        std::vector<int> values;
+    };
+
+    constexpr int messages = 10000;
+
+    utils::ActiveObject<Log> log;
+    log.set_max_batch(256);
+    for (int i = 0; i < messages; ++i) {
+        log.async([](){}, &Log::append, int(i));
+    }
+
+    const auto values = log.sync(&Log::get);
+    ASSERT_EQ(values.size(), size_t(messages));
+    for (int i = 0; i < messages; ++i) {
+        ASSERT_EQ(values[i], i);
+    }
+}
+
+TEST(ActiveObjectTest, manyActorsShareAThreadPool) {
+    class Log {
+    public:
+        void append(int value) { values.push_back(value); }
+        std::vector<int> get() { return values; }
+    private:
+        std::vector<int> values;
+    };
+
+    constexpr int actors = 1000;
+    constexpr int messages = 100;
+
+    utils::ThreadPool pool(4);
+    std::vector<std::unique_ptr<utils::ActiveObject<Log>>> logs;
+    for (int i = 0; i < actors; ++i) {
+        logs.emplace_back(new utils::ActiveObject<Log>(utils::executor_arg, pool));
+    }
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p) {
+        producers.emplace_back([&logs, p](){
+            for (int i = 0; i < messages; ++i) {
+                for (int a = p; a < actors; a += 4) {
+                    logs[a]->async([](){}, &Log::append, int(i));
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    for (auto& log : logs) {
+        const auto values = log->sync(&Log::get);
+        ASSERT_EQ(values.size(), size_t(messages));
+        for (int i = 0; i < messages; ++i) {
+            ASSERT_EQ(values[i], i);
+        }
+    }
+}
+
+TEST(ActiveObjectTest, pooledActorWithMpscQueueIsDestroyedAfterItsMessages) {
+    class Counter {
+    public:
+        explicit Counter(std::atomic<int>& destroyed) : destroyed(destroyed) {}
+        ~Counter() { destroyed.store(sum); }
+        void add(int value) { sum += value; }
+    private:
+        std::atomic<int>& destroyed;
+        int sum = 0;
+    };
+
+    utils::ThreadPool pool(2);
+    std::atomic<int> destroyed { -1 };
+    {
+        utils::ActiveObject<Counter, utils::MpscQueue> counter(utils::executor_arg, pool, destroyed);
+        for (int i = 0; i < 1000; ++i) {
+            counter.async([](){}, &Counter::add, 1);
+        }
+    }
+    ASSERT_EQ(destroyed.load(), 1000);
+}
+
+TEST(ActiveObjectTest, asyncReturnsFutureWithContinuationsOnTheActor) {
+    class Calculator {
+    public:
+        void hold(std::shared_future<void> gate) { gate.wait(); }
+        int square(int value) { return value * value; }
+        std::thread::id thread() { return std::this_thread::get_id(); }
+    };
+
+    utils::ActiveObject<Calculator> calculator;
+    const auto actor_thread = calculator.sync(&Calculator::thread);
+
+    // keep the call pending until the continuations are attached
+    std::promise<void> gate;
+    calculator.async(&Calculator::hold, gate.get_future().share());
+    auto future = calculator.async(&Calculator::square, 7)
+            .then([actor_thread](int value){
+                EXPECT_EQ(std::this_thread::get_id(), actor_thread);
+                return value + 1;
+            })
+            .then([](int value){
+                return std::to_string(value);
+            });
+    gate.set_value();
+
+    ASSERT_EQ(future.get(), "50");
+}
+
+TEST(ActiveObjectTest, continuationCanRunOnAnotherExecutor) {
+    class Calculator {
+    public:
+        int twice(int value) { return 2 * value; }
+    };
+
+    utils::ThreadPool pool(1);
+    utils::ActiveObject<Calculator> calculator;
+
+    auto future = calculator.async(&Calculator::twice, 21)
+            .then(pool, [&pool](int value){
+                EXPECT_TRUE(pool.in_worker());
+                return value;
+            });
+
+    ASSERT_EQ(future.get(), 42);
+}
+
+TEST(ActiveObjectTest, cancelCompletesPendingCallsWithCancelledError) {
+    class Worker {
+    public:
+        void hold(std::shared_future<void> gate) { gate.wait(); }
+        int value() { return 1; }
+    };
+
+    utils::ActiveObject<Worker> worker;
+    std::promise<void> gate;
+    auto held = worker.async(&Worker::hold, gate.get_future().share());
+
+    std::vector<utils::Future<int>> pending;
+    for (int i = 0; i < 10; ++i) {
+        pending.push_back(worker.async(&Worker::value));
+    }
+    auto chained = worker.async(&Worker::value).then([](int value){ return value + 1; });
+    auto blocked_sync = std::async(std::launch::async, [&worker](){
+        return worker.sync(&Worker::value);
+    });
+
+    // let the sync call reach the mailbox before cancelling
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    worker.cancel();
+    gate.set_value();
+
+    held.get();
+    for (auto& future : pending) {
+        ASSERT_THROW(future.get(), utils::CancelledError);
+    }
+    ASSERT_THROW(chained.get(), utils::CancelledError);
+    ASSERT_THROW(blocked_sync.get(), utils::CancelledError);
+
+    ASSERT_EQ(worker.sync(&Worker::value), 1);
+}
+
+TEST(ActiveObjectTest, exceptionsReachTheCaller) {
+    class Thrower {
+    public:
+        int fail() { throw std::logic_error("boom"); }
+    };
+
+    utils::ActiveObject<Thrower> thrower;
+    ASSERT_THROW(thrower.sync(&Thrower::fail), std::logic_error);
+    ASSERT_THROW(thrower.async(&Thrower::fail).get(), std::logic_error);
+}
+
+TEST(ActiveObjectTest, boundedMailboxAppliesOverflowPolicy) {
+    class Worker {
+    public:
+        void hold(std::promise<void>* entered, std::shared_future<void> gate) {
+            entered->set_value();
+            gate.wait();
+        }
+        int value(int v) { return v; }
+    };
+
+    std::promise<void> fail_gate;
+    std::promise<void> drop_gate;
+    {
+        utils::ActiveObject<Worker, utils::Bounded<4, utils::Overflow::Fail>::type> failing;
+        std::promise<void> entered;
+        failing.async(&Worker::hold, &entered, fail_gate.get_future().share());
+        entered.get_future().wait();
+
+        // the worker is stuck in hold, so the mailbox fills up
+        int accepted = 0;
+        while (failing.try_post([](int){}, &Worker::value, 1)) {
+            ++accepted;
+        }
+        ASSERT_EQ(accepted, 4);
+        ASSERT_THROW(failing.async(&Worker::value, 2).get(), utils::CancelledError);
+        fail_gate.set_value();
+    }
+    {
+        utils::ActiveObject<Worker, utils::Bounded<4, utils::Overflow::DropOldest>::type> dropping;
+        std::promise<void> entered;
+        dropping.async(&Worker::hold, &entered, drop_gate.get_future().share());
+        entered.get_future().wait();
+
+        std::vector<utils::Future<int>> futures;
+        for (int i = 0; i < 8; ++i) {
+            futures.push_back(dropping.async(&Worker::value, int(i)));
+        }
+        drop_gate.set_value();
+
+        for (int i = 0; i < 4; ++i) {
+            ASSERT_THROW(futures[i].get(), utils::CancelledError);
+        }
+        for (int i = 4; i < 8; ++i) {
+            ASSERT_EQ(futures[i].get(), i);
+        }
+    }
+}
+
+TEST(ActiveObjectTest, urgentCallsOvertakeBulkOnes) {
+    class Log {
+    public:
+        void hold(std::promise<void>* entered, std::shared_future<void> gate) {
+            entered->set_value();
+            gate.wait();
+        }
+        void append(int value) { values.push_back(value); }
+        std::vector<int> get() { return values; }
+    private:
+        std::vector<int> values;
+    };
+
+    utils::ActiveObject<Log, utils::Prioritized<2>::type> log;
+    std::promise<void> entered;
+    std::promise<void> gate;
+    log.async(&Log::hold, &entered, gate.get_future().share());
+    entered.get_future().wait();
+
+    for (int i = 0; i < 100; ++i) {
+        log.async([](){}, &Log::append, int(i));
+    }
+    log.async(utils::priority(1), [](){}, &Log::append, -1);
+    gate.set_value();
+
+    const auto values = log.sync(&Log::get);
+    ASSERT_EQ(values.size(), 101u);
+    ASSERT_EQ(values.front(), -1);
+    ASSERT_EQ(values.back(), 99);
+}
+
+TEST(ActiveObjectTest, expiredCallsCompleteWithTimeoutError) {
+    class Worker {
+    public:
+        void hold(std::promise<void>* entered, std::shared_future<void> gate) {
+            entered->set_value();
+            gate.wait();
+        }
+        int value() { return ++calls; }
+    private:
+        int calls = 0;
+    };
+
+    utils::ActiveObject<Worker> worker;
+    std::promise<void> entered;
+    std::promise<void> gate;
+    worker.async(&Worker::hold, &entered, gate.get_future().share());
+    entered.get_future().wait();
+
+    auto expiring = worker.async(utils::timeout(std::chrono::milliseconds(1)), &Worker::value);
+    auto relaxed = worker.async(utils::timeout(std::chrono::hours(1)), &Worker::value);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.set_value();
+
+    ASSERT_THROW(expiring.get(), utils::TimeoutError);
+    ASSERT_EQ(relaxed.get(), 1);
+    ASSERT_THROW(worker.sync(utils::deadline(utils::CallOptions::Clock::now()), &Worker::value),
+                 utils::TimeoutError);
+    ASSERT_EQ(worker.sync(&Worker::value), 2);
+}
+
+TEST(ActiveObjectTest, statsRecordDepthAndLatencies) {
+    class Worker {
+    public:
+        void hold(std::promise<void>* entered, std::shared_future<void> gate) {
+            entered->set_value();
+            gate.wait();
+        }
+        void sleep() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        void noop() {}
+    };
+
+    utils::ActiveObject<Worker, utils::ConcurrentQueue, utils::ActorStats> worker;
+    std::promise<void> entered;
+    std::promise<void> gate;
+    worker.async(&Worker::hold, &entered, gate.get_future().share());
+    entered.get_future().wait();
+
+    for (int i = 0; i < 10; ++i) {
+        worker.async([](){}, &Worker::sleep);
+    }
+    ASSERT_EQ(worker.stats().snapshot().queue_depth, 10);
+    gate.set_value();
+    worker.sync(&Worker::sleep);
+    // a call is counted as executed after its caller was released, the
+    // one that follows makes sure the twelve above are
+    worker.sync(&Worker::noop);
+
+    const auto stats = worker.stats().snapshot();
+    ASSERT_EQ(stats.enqueued, 13u);
+    ASSERT_GE(stats.executed, 12u);
+    ASSERT_EQ(stats.queue_depth, 0);
+    // 11 if the sync call got in before the worker took the first one
+    ASSERT_GE(stats.max_queue_depth, 10);
+    ASSERT_LE(stats.max_queue_depth, 11);
+    ASSERT_GE(stats.execution.count, 12u);
+    ASSERT_GE(stats.execution.percentile(0.5), 1000000u * 15 / 16);
+    ASSERT_EQ(stats.queue_wait.count, 13u);
+    // the last call waited for the ten before it
+    ASSERT_GE(stats.queue_wait.percentile(1.0), 10000000u * 15 / 16);
+}
+
+TEST(ActiveObjectTest, statsCountExpiredCallsApart) {
+    class Worker {
+    public:
+        void hold(std::promise<void>* entered, std::shared_future<void> gate) {
+            entered->set_value();
+            gate.wait();
+        }
+        int value() { return 1; }
+    };
+
+    utils::ActiveObject<Worker, utils::ConcurrentQueue, utils::ActorStats> worker;
+    std::promise<void> entered;
+    std::promise<void> gate;
+    worker.async(&Worker::hold, &entered, gate.get_future().share());
+    entered.get_future().wait();
+
+    std::vector<utils::Future<int>> expiring;
+    for (int i = 0; i < 5; ++i) {
+        expiring.push_back(worker.async(utils::deadline(utils::CallOptions::Clock::now()), &Worker::value));
+    }
+    gate.set_value();
+    ASSERT_EQ(worker.sync(&Worker::value), 1);
+    for (auto& call : expiring) {
+        ASSERT_THROW(call.get(), utils::TimeoutError);
+    }
+
+    const auto stats = worker.stats().snapshot();
+    ASSERT_EQ(stats.enqueued, 7u);
+    ASSERT_EQ(stats.expired, 5u);
+    // the hold and the sync call, whose caller may have been released
+    // before it was counted
+    ASSERT_GE(stats.executed, 1u);
+    ASSERT_LE(stats.executed, 2u);
+    ASSERT_EQ(stats.execution.count, stats.executed);
+    ASSERT_EQ(stats.queue_wait.count, 7u);
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "actor_stats.h"
+
+using utils::LatencyHistogram;
+
+TEST(actor_stats, histogramBucketsAreLogLinear) {
+    for (uint64_t value = 0; value < 16; ++value) {
+        ASSERT_EQ(LatencyHistogram::index(value), value);
+    }
+    ASSERT_EQ(LatencyHistogram::index(16), 16u);
+    ASSERT_EQ(LatencyHistogram::index(33), LatencyHistogram::index(32));
+    ASSERT_EQ(LatencyHistogram::index(uint64_t(1) << 60), LatencyHistogram::bucket_count - 1);
+
+    for (uint64_t value = 1; value < (uint64_t(1) << 40); value = value * 3 + 1) {
+        const auto bound = LatencyHistogram::lower_bound(LatencyHistogram::index(value));
+        ASSERT_LE(bound, value);
+        // within one sixteenth of the magnitude
+        ASSERT_LE(value - bound, value / 16);
+    }
+}
+
+TEST(actor_stats, snapshotReportsPercentiles) {
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.snapshot().percentile(0.5), 0u);
+
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.record(value);
+    }
+    const auto snapshot = histogram.snapshot();
+    ASSERT_EQ(snapshot.count, 1000u);
+    ASSERT_NEAR(double(snapshot.percentile(0.5)), 500.0, 500.0 / 16);
+    ASSERT_NEAR(double(snapshot.percentile(0.99)), 990.0, 990.0 / 16);
+    ASSERT_EQ(snapshot.percentile(1.0), LatencyHistogram::lower_bound(LatencyHistogram::index(1000)));
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <map>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arena_allocator.h"
+
+namespace {
+
+struct VectorArena
+    : public ArenaHolder {
+    explicit VectorArena(size_t n)
+        : block(n) {}
+    char *begin() noexcept override { return block.data(); }
+    size_t size() const noexcept override { return block.size(); }
+    std::vector<char> block;
+};
+
+template <class T>
+using Vector = std::vector<T, ArenaAllocator<T>>;
+
+using String = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+template <class K, class V>
+using UnorderedMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, ArenaAllocator<std::pair<const K, V>>>;
+
+struct alignas(64) CacheLine {
+    char bytes[64];
+};
+
+bool allocatedInside(VectorArena& arena, const void* ptr) {
+    const auto address = static_cast<const char*>(ptr);
+    return address >= arena.begin() && address < arena.begin() + arena.size();
+}
+
+}
+
+TEST(arena_allocator, containersLiveOnTheArena) {
+    VectorArena arena(1 << 20);
+    MergeAllocator allocator(arena);
+    {
+        Vector<int> numbers { ArenaAllocator<int>(allocator) };
+        for (int i = 0; i < 10000; ++i) {
+            numbers.push_back(i);
+        }
+        ASSERT_TRUE(allocatedInside(arena, numbers.data()));
+        ASSERT_EQ(numbers[9999], 9999);
+
+        const ArenaAllocator<char> chars(allocator);
+        UnorderedMap<int, String> names(16, std::hash<int>(), std::equal_to<int>(), ArenaAllocator<std::pair<const int, String>>(allocator));
+        for (int i = 0; i < 1000; ++i) {
+            const auto name = "a string too long for the small buffer #" + std::to_string(i);
+            names.emplace(i, String(name.begin(), name.end(), chars));
+        }
+        ASSERT_EQ(names.at(500), String("a string too long for the small buffer #500", chars));
+        ASSERT_TRUE(allocatedInside(arena, names.at(500).data()));
+
+        std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int>>> ordered { ArenaAllocator<std::pair<const int, int>>(allocator) };
+        for (int i = 0; i < 1000; ++i) {
+            ordered[i] = -i;
+        }
+        ASSERT_EQ(ordered.rbegin()->second, -999);
+    }
+    // everything came back and merged
+    const auto whole = allocator.allocate(arena.size());
+    ASSERT_EQ(whole, arena.begin());
+}
+
+TEST(arena_allocator, honoursOverAlignedTypes) {
+    VectorArena arena(1 << 16);
+    MergeAllocator allocator(arena);
+    {
+        std::vector<Vector<CacheLine>> vectors;
+        for (int i = 1; i < 20; ++i) {
+            vectors.emplace_back(i, CacheLine {}, ArenaAllocator<CacheLine>(allocator));
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(vectors.back().data()) % 64, 0u);
+        }
+    }
+    ASSERT_EQ(allocator.allocate(arena.size()), arena.begin());
+}
+
+TEST(arena_allocator, comparesEqualByArena) {
+    VectorArena first_arena(1024);
+    VectorArena second_arena(1024);
+    MergeAllocator first(first_arena);
+    MergeAllocator second(second_arena);
+
+    ASSERT_EQ(ArenaAllocator<int>(first), ArenaAllocator<double>(first));
+    ASSERT_NE(ArenaAllocator<int>(first), ArenaAllocator<int>(second));
+    ASSERT_EQ(ArenaAllocator<char>(ArenaAllocator<int>(second)), ArenaAllocator<char>(second));
+}
+
+TEST(arena_allocator, throwsWhenTheArenaIsFull) {
+    VectorArena arena(1024);
+    MergeAllocator allocator(arena);
+
+    Vector<int> numbers { ArenaAllocator<int>(allocator) };
+    ASSERT_THROW(numbers.reserve(1024), std::bad_alloc);
+    ASSERT_NO_THROW(numbers.reserve(128));
+}
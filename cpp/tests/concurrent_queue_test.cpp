@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "concurrent_queue.h"
+
+TEST(concurrent_queue, mpscQueueKeepsPerProducerOrderUnderContention) {
+    constexpr int producers = 16;
+    constexpr int per_producer = 20000;
+
+    auto queue = std::make_shared<utils::MpscQueue<std::pair<int, int>>>();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([queue, p](){
+            for (int i = 0; i < per_producer; ++i) {
+                queue->push(std::make_pair(p, i));
+            }
+        });
+    }
+
+    std::vector<int> expected(producers, 0);
+    for (int received = 0; received < producers * per_producer; ++received) {
+        queue->wait([&expected](const std::pair<int, int>& elem){
+            ASSERT_EQ(expected[elem.first], elem.second);
+            ++expected[elem.first];
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(expected, std::vector<int>(producers, per_producer));
+}
+
+TEST(concurrent_queue, drainTakesAtMostMaxBatch) {
+    utils::ConcurrentQueue<int> queue;
+    for (int i = 0; i < 10; ++i) {
+        queue.push(int(i));
+    }
+
+    std::vector<int> drained;
+    auto collect = [&drained](int elem){
+        drained.push_back(elem);
+        return true;
+    };
+
+    queue.drain(collect, 4);
+    ASSERT_EQ(drained, std::vector<int>({0, 1, 2, 3}));
+
+    queue.drain(collect, 100);
+    ASSERT_EQ(drained.size(), 10u);
+    ASSERT_EQ(drained.back(), 9);
+}
+
+TEST(concurrent_queue, boundedQueueWithFailPolicyRejectsWhenFull) {
+    utils::BoundedQueue<int, 4, utils::Overflow::Fail> queue;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(queue.push(int(i)));
+    }
+
+    int rejected = 42;
+    ASSERT_FALSE(queue.push(std::move(rejected)));
+    ASSERT_EQ(rejected, 42);
+    ASSERT_EQ(queue.size(), 4u);
+}
+
+TEST(concurrent_queue, boundedQueueWithDropOldestKeepsNewest) {
+    utils::BoundedQueue<int, 4, utils::Overflow::DropOldest> queue;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(queue.push(int(i)));
+    }
+
+    std::vector<int> drained;
+    queue.try_drain([&drained](int elem){
+        drained.push_back(elem);
+        return true;
+    }, 100);
+    ASSERT_EQ(drained, std::vector<int>({6, 7, 8, 9}));
+}
+
+TEST(concurrent_queue, boundedQueueBlocksProducersUntilConsumed) {
+    constexpr int producers = 8;
+    constexpr int per_producer = 20000;
+
+    utils::BoundedQueue<std::pair<int, int>, 64> queue;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, p](){
+            for (int i = 0; i < per_producer; ++i) {
+                queue.push(std::make_pair(p, i));
+            }
+        });
+    }
+
+    std::vector<int> expected(producers, 0);
+    for (int received = 0; received < producers * per_producer;) {
+        queue.drain([&expected, &received](const std::pair<int, int>& elem){
+            EXPECT_EQ(expected[elem.first], elem.second);
+            ++expected[elem.first];
+            ++received;
+            return true;
+        }, 16);
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(expected, std::vector<int>(producers, per_producer));
+    ASSERT_TRUE(queue.empty());
+}
+
+TEST(concurrent_queue, priorityQueueServesHighestLaneFirst) {
+    struct Item {
+        unsigned priority;
+        int value;
+    };
+
+    utils::PriorityQueue<Item, 3> queue;
+    queue.push(Item{0, 1});
+    queue.push(Item{2, 2});
+    queue.push(Item{1, 3});
+    queue.push(Item{7, 4});
+    queue.push(Item{0, 5});
+
+    std::vector<int> order;
+    while (!queue.empty()) {
+        queue.drain([&order](const Item& item){
+            order.push_back(item.value);
+            return true;
+        }, 2);
+    }
+    ASSERT_EQ(order, std::vector<int>({2, 4, 3, 1, 5}));
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "active_object.h"
+#include "coroutine.h"
+
+namespace {
+
+class Account {
+public:
+    void deposit(int amount) { balance += amount; }
+    int get_balance() { return balance; }
+    void fail() { throw std::runtime_error("rejected"); }
+    std::thread::id thread() { return std::this_thread::get_id(); }
+private:
+    int balance = 0;
+};
+
+utils::Task<int> deposit_twice(utils::ActiveObject<Account>& account, int amount) {
+    co_await account.call(&Account::deposit, amount);
+    co_await account.call(&Account::deposit, amount);
+    co_return co_await account.call(&Account::get_balance);
+}
+
+utils::Task<void> transfer(utils::ActiveObject<Account>& from, utils::ActiveObject<Account>& to, int amount) {
+    co_await from.call(&Account::deposit, -amount);
+    co_await to.call(&Account::deposit, amount);
+}
+
+} // namespace
+
+TEST(coroutine, awaitsActorCallsInSequence) {
+    utils::ActiveObject<Account> account;
+    ASSERT_EQ(utils::sync_wait(deposit_twice(account, 5)), 10);
+}
+
+TEST(coroutine, exceptionsReachTheAwaitingCoroutine) {
+    utils::ActiveObject<Account> account;
+    auto failing = [](utils::ActiveObject<Account>& account) -> utils::Task<std::string> {
+        try {
+            co_await account.call(&Account::fail);
+        } catch (const std::runtime_error& e) {
+            co_return e.what();
+        }
+        co_return "";
+    };
+    ASSERT_EQ(utils::sync_wait(failing(account)), "rejected");
+
+    auto expiring = [](utils::ActiveObject<Account>& account) -> utils::Task<int> {
+        co_return co_await account.call(utils::deadline(utils::CallOptions::Clock::now()), &Account::get_balance);
+    };
+    ASSERT_THROW(utils::sync_wait(expiring(account)), utils::TimeoutError);
+}
+
+TEST(coroutine, resumesInlineOrOnTheGivenExecutor) {
+    utils::ActiveObject<Account> account;
+    utils::Scheduler scheduler(1);
+    const auto scheduler_thread = utils::sync_wait([](utils::Scheduler& scheduler) -> utils::Task<std::thread::id> {
+        co_await scheduler.schedule();
+        co_return std::this_thread::get_id();
+    }(scheduler));
+
+    auto probe = [](utils::ActiveObject<Account>& account, utils::Scheduler& scheduler)
+            -> utils::Task<std::pair<bool, bool>> {
+        const auto actor_thread = co_await account.call(&Account::thread);
+        const bool inline_on_actor = std::this_thread::get_id() == actor_thread;
+        co_await account.call(&Account::thread).resume_on(scheduler);
+        co_return std::make_pair(inline_on_actor, std::this_thread::get_id() != actor_thread);
+    };
+    const auto result = utils::sync_wait(probe(account, scheduler));
+    ASSERT_TRUE(result.first);
+    ASSERT_TRUE(result.second);
+    ASSERT_NE(scheduler_thread, std::this_thread::get_id());
+}
+
+TEST(coroutine, schedulerRunsThousandsOfConversations) {
+    constexpr int conversations = 2000;
+
+    utils::ActiveObject<Account> a;
+    utils::ActiveObject<Account> b;
+    std::atomic<int> finished { 0 };
+    std::promise<void> all_done;
+    {
+        utils::Scheduler scheduler(2);
+        auto conversation = [](utils::ActiveObject<Account>& a, utils::ActiveObject<Account>& b,
+                               utils::Scheduler& scheduler, std::atomic<int>& finished,
+                               std::promise<void>& all_done) -> utils::Task<void> {
+            co_await transfer(a, b, 1);
+            co_await b.call(&Account::get_balance).resume_on(scheduler);
+            if (finished.fetch_add(1) + 1 == conversations) {
+                all_done.set_value();
+            }
+        };
+        for (int i = 0; i < conversations; ++i) {
+            scheduler.spawn(conversation(a, b, scheduler, finished, all_done));
+        }
+        all_done.get_future().wait();
+    }
+    ASSERT_EQ(a.sync(&Account::get_balance), -conversations);
+    ASSERT_EQ(b.sync(&Account::get_balance), conversations);
+}
+
+TEST(coroutine, schedulerFinishesTasksHoppingBetweenThreads) {
+    constexpr int hops = 1000;
+    constexpr int tasks = 8;
+
+    std::atomic<int> finished { 0 };
+    {
+        utils::Scheduler scheduler(3);
+        auto hopper = [](utils::Scheduler& scheduler, std::atomic<int>& finished) -> utils::Task<void> {
+            for (int i = 0; i < hops; ++i) {
+                co_await scheduler.schedule();
+            }
+            ++finished;
+        };
+        for (int i = 0; i < tasks; ++i) {
+            scheduler.spawn(hopper(scheduler, finished));
+        }
+        // destroyed while they hop
+    }
+    ASSERT_EQ(finished.load(), tasks);
+}
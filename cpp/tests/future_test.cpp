@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "future.h"
+
+namespace {
+
+template <class T>
+utils::__impl::Ref<utils::__impl::State<T>> make_state() {
+    return utils::__impl::Ref<utils::__impl::State<T>>(new utils::__impl::State<T>);
+}
+
+} // namespace
+
+TEST(future, getReturnsValueSetFromAnotherThread) {
+    auto state = make_state<std::string>();
+    utils::Future<std::string> future(state);
+
+    std::thread producer([state](){
+        state->set_value(std::string("value"));
+    });
+
+    ASSERT_EQ(future.get(), "value");
+    ASSERT_FALSE(future.valid());
+    producer.join();
+}
+
+TEST(future, thenOnReadyFutureRunsInline) {
+    auto state = make_state<int>();
+    state->set_value(20);
+
+    bool ran = false;
+    auto next = utils::Future<int>(state).then([&ran](int value){
+        ran = true;
+        return value + 1;
+    });
+
+    ASSERT_TRUE(ran);
+    ASSERT_TRUE(next.ready());
+    ASSERT_EQ(next.get(), 21);
+}
+
+TEST(future, errorsSkipContinuations) {
+    auto state = make_state<void>();
+    bool ran = false;
+    auto next = utils::Future<void>(state).then([&ran](){
+        ran = true;
+    });
+
+    state->cancel();
+
+    ASSERT_THROW(next.get(), utils::CancelledError);
+    ASSERT_FALSE(ran);
+}
+
+TEST(future, throwingContinuationFailsTheNextFuture) {
+    auto state = make_state<int>();
+    auto next = utils::Future<int>(state).then([](int) -> int {
+        throw std::runtime_error("continuation");
+    });
+
+    state->set_value(1);
+
+    ASSERT_THROW(next.get(), std::runtime_error);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "growable_allocator.h"
+
+namespace {
+
+constexpr size_t mib = 1024 * 1024;
+
+// resident pages among the whole pages of [begin, begin + size)
+size_t residentPages(char* begin, size_t size) {
+    const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto first = (reinterpret_cast<uintptr_t>(begin) + page - 1) / page * page;
+    const auto last = (reinterpret_cast<uintptr_t>(begin) + size) / page * page;
+    std::vector<unsigned char> pages((last - first) / page);
+    if (mincore(reinterpret_cast<void*>(first), last - first, pages.data()) != 0) {
+        return 0;
+    }
+    size_t resident = 0;
+    for (const auto flags : pages) {
+        resident += flags & 1;
+    }
+    return resident;
+}
+
+GrowableAllocator::Options smallChunks() {
+    GrowableAllocator::Options options;
+    options.chunk_size = mib;
+    return options;
+}
+
+}
+
+TEST(growable_allocator, mapsAnotherChunkWhenFull) {
+    GrowableAllocator allocator(smallChunks());
+
+    std::vector<char*> blocks;
+    for (int i = 0; i < 16; ++i) {
+        const auto ptr = allocator.allocate(256 * 1024);
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, i, 256 * 1024);
+        blocks.push_back(ptr);
+    }
+    ASSERT_GE(allocator.chunkCount(), 4u);
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_EQ(blocks[i][0], i);
+        ASSERT_EQ(blocks[i][256 * 1024 - 1], i);
+    }
+
+    const auto chunks = allocator.chunkCount();
+    for (const auto ptr : blocks) {
+        allocator.deallocate(ptr, 256 * 1024);
+    }
+    for (int i = 0; i < 16; ++i) {
+        ASSERT_NE(allocator.allocate(256 * 1024), nullptr);
+    }
+    ASSERT_EQ(allocator.chunkCount(), chunks);
+}
+
+TEST(growable_allocator, fitsRequestsLargerThanAChunk) {
+    GrowableAllocator allocator(smallChunks());
+
+    const auto small = allocator.allocate(100);
+    const auto large = allocator.allocate(5 * mib);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(large, nullptr);
+    std::memset(large, 1, 5 * mib);
+    ASSERT_EQ(allocator.chunkCount(), 2u);
+
+    allocator.deallocate(large, 5 * mib);
+    allocator.deallocate(small, 100);
+    ASSERT_EQ(allocator.allocate(5 * mib), large);
+}
+
+TEST(growable_allocator, givesLargeFreeRangesBackToTheKernel) {
+    auto options = smallChunks();
+    options.chunk_size = 16 * mib;
+    GrowableAllocator allocator(options);
+
+    const auto size = 8 * mib;
+    const auto ptr = allocator.allocate(size);
+    ASSERT_NE(ptr, nullptr);
+    std::memset(ptr, 1, size);
+    const auto touched = residentPages(ptr, size);
+    ASSERT_GT(touched, 0u);
+
+    allocator.deallocate(ptr, size);
+    ASSERT_LT(residentPages(ptr, size), touched / 8);
+
+    // and the memory is usable again
+    const auto again = allocator.allocate(size);
+    ASSERT_EQ(again, ptr);
+    std::memset(again, 2, size);
+    ASSERT_EQ(again[size - 1], 2);
+}
+
+TEST(growable_allocator, keepsFreedMemoryWithoutAThreshold) {
+    auto options = smallChunks();
+    options.release_threshold = 0;
+    GrowableAllocator allocator(options);
+
+    const auto size = 512 * 1024;
+    const auto ptr = allocator.allocate(size);
+    std::memset(ptr, 1, size);
+    const auto touched = residentPages(ptr, size);
+    allocator.deallocate(ptr, size);
+    ASSERT_EQ(residentPages(ptr, size), touched);
+}
+
+TEST(growable_allocator, worksWithHugePagesRequested) {
+    for (const auto huge_pages : { HugePages::transparent, HugePages::hugetlb }) {
+        GrowableAllocator::Options options;
+        options.chunk_size = 4 * mib;
+        options.huge_pages = huge_pages;
+        GrowableAllocator allocator(options);
+
+        // whether the kernel has any to give or not
+        const auto ptr = allocator.allocate(3 * mib);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % MmapArena::huge_page_size, 0u);
+        std::memset(ptr, 1, 3 * mib);
+        allocator.deallocate(ptr, 3 * mib);
+        ASSERT_EQ(allocator.allocate(3 * mib), ptr);
+    }
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_resource.h"
+
+namespace {
+
+struct VectorArena
+    : public ArenaHolder {
+    explicit VectorArena(size_t n)
+        : block(n) {}
+    char *begin() noexcept override { return block.data(); }
+    size_t size() const noexcept override { return block.size(); }
+    std::vector<char> block;
+};
+
+}
+
+TEST(memory_resource, pmrContainersLiveOnTheArena) {
+    VectorArena arena(1 << 20);
+    MergeAllocator allocator(arena);
+    MergeResource resource(allocator);
+    {
+        std::pmr::unordered_map<int, std::pmr::string> names(&resource);
+        for (int i = 0; i < 1000; ++i) {
+            names.emplace(i, "a string too long for the small buffer #" + std::to_string(i));
+        }
+        const auto& name = names.at(500);
+        ASSERT_EQ(name, "a string too long for the small buffer #500");
+        ASSERT_GE(name.data(), arena.begin());
+        ASSERT_LT(name.data(), arena.begin() + arena.size());
+
+        std::pmr::vector<std::pmr::vector<int>> nested(&resource);
+        for (int i = 0; i < 100; ++i) {
+            nested.emplace_back(i, i);
+        }
+        ASSERT_EQ(nested[99].get_allocator().resource(), &resource);
+    }
+    ASSERT_EQ(allocator.allocate(arena.size()), arena.begin());
+}
+
+TEST(memory_resource, alignsAsAsked) {
+    VectorArena arena(1 << 16);
+    MergeAllocator allocator(arena);
+    MergeResource resource(allocator);
+
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (size_t alignment = 1; alignment <= 4096; alignment *= 2) {
+        const auto ptr = resource.allocate(24, alignment);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0u);
+        blocks.emplace_back(ptr, alignment);
+    }
+    for (const auto& block : blocks) {
+        resource.deallocate(block.first, 24, block.second);
+    }
+    ASSERT_EQ(allocator.allocate(arena.size()), arena.begin());
+}
+
+TEST(memory_resource, equalByArena) {
+    VectorArena arena(1024);
+    MergeAllocator allocator(arena);
+    MergeResource first(allocator);
+    MergeResource second(allocator);
+
+    VectorArena other_arena(1024);
+    MergeAllocator other_allocator(other_arena);
+    MergeResource other(other_allocator);
+
+    ASSERT_TRUE(first.is_equal(second));
+    ASSERT_FALSE(first.is_equal(other));
+    ASSERT_FALSE(first.is_equal(*std::pmr::new_delete_resource()));
+
+    // freed through the other one
+    second.deallocate(first.allocate(100), 100);
+    ASSERT_EQ(allocator.allocate(arena.size()), arena.begin());
+}
+
+TEST(memory_resource, throwsWhenTheArenaIsFull) {
+    VectorArena arena(1024);
+    MergeAllocator allocator(arena);
+    MergeResource resource(allocator);
+
+    ASSERT_THROW(static_cast<void>(resource.allocate(2048)), std::bad_alloc);
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "monotonic_allocator.h"
+
+namespace {
+
+struct VectorArena
+    : public ArenaHolder {
+    explicit VectorArena(size_t n)
+        : block(n) {}
+    char *begin() noexcept override { return block.data(); }
+    size_t size() const noexcept override { return block.size(); }
+    std::vector<char> block;
+};
+
+}
+
+TEST(monotonic_allocator, bumpsThroughTheArena) {
+    VectorArena arena(1024);
+    VectorArena heap_arena(4096);
+    MergeAllocator heap(heap_arena);
+    MonotonicAllocator allocator(arena, heap);
+
+    const auto a = allocator.allocate(10, 1);
+    const auto b = allocator.allocate(5, 1);
+    const auto c = allocator.allocate(8, 64);
+    ASSERT_EQ(a, arena.begin());
+    ASSERT_EQ(b, a + 10);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(c) % 64, 0u);
+    ASSERT_EQ(allocator.used(), size_t(c + 8 - arena.begin()));
+}
+
+TEST(monotonic_allocator, scopesGiveEverythingBackAtOnce) {
+    VectorArena arena(1024);
+    VectorArena heap_arena(4096);
+    MergeAllocator heap(heap_arena);
+    MonotonicAllocator allocator(arena, heap);
+
+    const auto kept = allocator.allocate(100);
+    char* inner = nullptr;
+    {
+        MonotonicAllocator::Scope request(allocator);
+        const auto first = allocator.allocate(200);
+        {
+            MonotonicAllocator::Scope nested(allocator);
+            inner = allocator.allocate(300);
+        }
+        ASSERT_EQ(allocator.allocate(300), inner);
+        ASSERT_GT(inner, first);
+    }
+    ASSERT_EQ(allocator.used(), 100u);
+    ASSERT_EQ(allocator.allocate(16), kept + 112);
+}
+
+TEST(monotonic_allocator, overflowsToTheFallbackUntilRewound) {
+    VectorArena arena(256);
+    VectorArena heap_arena(4096);
+    MergeAllocator heap(heap_arena);
+    MonotonicAllocator allocator(arena, heap);
+
+    {
+        MonotonicAllocator::Scope request(allocator);
+        std::vector<char*> blocks;
+        for (int i = 0; i < 10; ++i) {
+            blocks.push_back(allocator.allocate(100, 64));
+            ASSERT_NE(blocks.back(), nullptr);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(blocks.back()) % 64, 0u);
+        }
+        ASSERT_GE(blocks.back(), heap_arena.begin());
+        ASSERT_LT(blocks.back(), heap_arena.begin() + heap_arena.size());
+    }
+    // every overflow is back in the fallback
+    const auto whole = heap.allocate(heap_arena.size());
+    ASSERT_EQ(whole, heap_arena.begin());
+    heap.deallocate(whole, heap_arena.size());
+}
+
+TEST(monotonic_allocator, lastingAllocationsOutliveTheScope) {
+    VectorArena arena(256);
+    VectorArena heap_arena(4096);
+    MergeAllocator heap(heap_arena);
+    MonotonicAllocator allocator(arena, heap);
+
+    char* lasting = nullptr;
+    {
+        MonotonicAllocator::Scope request(allocator);
+        allocator.allocate(1000);
+        lasting = allocator.allocateLasting(64);
+        std::fill(lasting, lasting + 64, 'x');
+        allocator.allocate(1000);
+    }
+    ASSERT_EQ(std::count(lasting, lasting + 64, 'x'), 64);
+    ASSERT_EQ(heap.allocate(heap_arena.size()), nullptr);
+    allocator.deallocateLasting(lasting, 64);
+    ASSERT_EQ(heap.allocate(heap_arena.size()), heap_arena.begin());
+}
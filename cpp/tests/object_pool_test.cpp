@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "object_pool.h"
+
+namespace {
+
+struct VectorArena
+    : public ArenaHolder {
+    explicit VectorArena(size_t n)
+        : block(n) {}
+    char *begin() noexcept override { return block.data(); }
+    size_t size() const noexcept override { return block.size(); }
+    std::vector<char> block;
+};
+
+struct Message {
+    Message(int id, std::string text)
+        : id { id }
+        , text { std::move(text) } {
+        if (id < 0) {
+            throw std::invalid_argument("negative id");
+        }
+    }
+
+    int id;
+    std::string text;
+};
+
+struct alignas(64) Padded {
+    char byte;
+};
+
+}
+
+TEST(object_pool, carvesTheArenaIntoSlotsInAddressOrder) {
+    VectorArena arena(10 * ObjectPool<Message>::slot_size + 8);
+    ObjectPool<Message> pool(arena);
+
+    std::vector<void*> slots;
+    while (const auto slot = pool.allocate()) {
+        slots.push_back(slot);
+    }
+    ASSERT_GE(slots.size(), 9u);
+    ASSERT_LE(slots.size(), 10u);
+    for (size_t i = 1; i < slots.size(); ++i) {
+        ASSERT_EQ(static_cast<char*>(slots[i]), static_cast<char*>(slots[i - 1]) + ObjectPool<Message>::slot_size);
+    }
+    ASSERT_EQ(pool.inUse(), slots.size());
+
+    // last freed, first reused
+    pool.deallocate(slots[3]);
+    pool.deallocate(slots[5]);
+    ASSERT_EQ(pool.allocate(), slots[5]);
+    ASSERT_EQ(pool.allocate(), slots[3]);
+    ASSERT_EQ(pool.allocate(), nullptr);
+}
+
+TEST(object_pool, createsAndDestroysObjects) {
+    VectorArena arena(4096);
+    MergeAllocator allocator(arena);
+    {
+        ObjectPool<Message> pool(allocator, 4);
+        std::vector<Message*> messages;
+        for (int i = 0; i < 20; ++i) {
+            messages.push_back(pool.create(i, "message " + std::to_string(i)));
+            ASSERT_NE(messages.back(), nullptr);
+        }
+        ASSERT_EQ(messages[13]->text, "message 13");
+
+        // a throwing constructor doesn't leak its slot
+        ASSERT_THROW(pool.create(-1, "broken"), std::invalid_argument);
+        ASSERT_EQ(pool.inUse(), 20u);
+
+        for (const auto message : messages) {
+            pool.destroy(message);
+        }
+        ASSERT_EQ(pool.inUse(), 0u);
+    }
+    // slabs went back
+    ASSERT_EQ(allocator.allocate(arena.size()), arena.begin());
+}
+
+TEST(object_pool, batchesGrowAcrossSlabs) {
+    VectorArena arena(1 << 16);
+    MergeAllocator allocator(arena);
+    ObjectPool<Padded> pool(allocator, 8);
+
+    void* slots[30];
+    ASSERT_EQ(pool.allocate(slots, 30), 30u);
+    const std::set<void*> distinct(std::begin(slots), std::end(slots));
+    ASSERT_EQ(distinct.size(), 30u);
+    for (const auto slot : slots) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(slot) % 64, 0u);
+    }
+
+    pool.deallocate(slots, 30);
+    ASSERT_EQ(pool.inUse(), 0u);
+    void* again[40];
+    ASSERT_EQ(pool.allocate(again, 40), 40u);
+    // the freed ones first, in the order they were given back
+    ASSERT_EQ(again[0], slots[0]);
+    ASSERT_EQ(again[29], slots[29]);
+    pool.deallocate(again, 40);
+}
+
+TEST(object_pool, stopsWhenTheSourceIsFull) {
+    VectorArena arena(1024);
+    MergeAllocator allocator(arena);
+    ObjectPool<Padded> pool(allocator, 4);
+
+    void* slots[100];
+    const auto taken = pool.allocate(slots, 100);
+    ASSERT_GT(taken, 0u);
+    ASSERT_LT(taken, 100u);
+    ASSERT_EQ(pool.allocate(), nullptr);
+    pool.deallocate(slots, taken);
+}
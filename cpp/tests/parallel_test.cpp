@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "parallel.h"
+#include "zip.h"
+
+TEST(parallel, forEachVisitsEveryRowOnce) {
+    utils::ThreadPool pool(4);
+    std::vector<int> x(100000);
+    std::iota(x.begin(), x.end(), 0);
+    std::vector<int> y(x.size(), 1);
+    std::vector<int64_t> z(x.size() + 10, -1);
+
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    utils::parallel_options options;
+    options.chunk_rows = 1000;
+    utils::parallel_for_each(pool, utils::zip(x, y, z), [&](auto&& row) {
+        std::get<2>(row) = std::get<0>(row) + std::get<1>(row);
+        if (std::get<0>(row) % 1000 == 0) {
+            std::lock_guard<std::mutex> guard(mutex);
+            threads.insert(std::this_thread::get_id());
+        }
+    }, options);
+
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        ASSERT_EQ(z[i], int64_t(i) + 1) << i;
+    }
+    ASSERT_EQ(z[x.size()], -1);
+    ASSERT_GE(threads.size(), 1u);
+}
+
+TEST(parallel, emptyRangeRunsNothing) {
+    utils::ThreadPool pool(2);
+    std::vector<int> empty;
+    utils::parallel_for_each(pool, empty, [](int) { FAIL(); });
+    ASSERT_EQ(utils::transform_reduce(pool, empty, 7, std::plus<>(), [](int v) { return v; }), 7);
+}
+
+TEST(parallel, transformReduceMatchesSerial) {
+    utils::ThreadPool pool(4);
+    std::vector<int64_t> a(123457);
+    std::iota(a.begin(), a.end(), 1);
+    std::vector<int64_t> b(a.size(), 2);
+
+    int64_t expected = 10;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        expected += a[i] * b[i];
+    }
+    const auto dot = utils::transform_reduce(pool, utils::zip(a, b), int64_t(10), std::plus<>(), [](const auto& row) {
+        return std::get<0>(row) * std::get<1>(row);
+    });
+    ASSERT_EQ(dot, expected);
+}
+
+TEST(parallel, deterministicReductionIsTheSameOnAnyPool) {
+    std::vector<float> values(1 << 18);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = 1.0f / float(i + 1);
+    }
+    utils::parallel_options options;
+    options.deterministic = true;
+    options.chunk_rows = 777;
+
+    const auto sum = [&](std::size_t threads) {
+        utils::ThreadPool pool(threads);
+        return utils::transform_reduce(pool, values, 0.0f, std::plus<>(), [](float v) { return v; }, options);
+    };
+    const auto once = sum(1);
+    for (int run = 0; run < 5; ++run) {
+        ASSERT_EQ(sum(4), once);
+        ASSERT_EQ(sum(3), once);
+    }
+}
+
+TEST(parallel, exceptionsComeOutOfTheCall) {
+    utils::ThreadPool pool(4);
+    std::vector<int> values(10000, 0);
+    values[5000] = 1;
+    utils::parallel_options options;
+    options.chunk_rows = 100;
+
+    ASSERT_THROW(utils::parallel_for_each(pool, values, [](int value) {
+        if (value == 1) {
+            throw std::runtime_error("bad row");
+        }
+    }, options), std::runtime_error);
+
+    // and the pool is still fine
+    std::atomic<int> rows { 0 };
+    utils::parallel_for_each(pool, values, [&rows](int) { ++rows; }, options);
+    ASSERT_EQ(rows.load(), 10000);
+}
+
+TEST(parallel, worksFromInsideTheOnlyWorker) {
+    utils::ThreadPool pool(1);
+    std::vector<int> values(50000, 1);
+    std::promise<int> result;
+
+    pool.post([&]() {
+        utils::parallel_options options;
+        options.chunk_rows = 64;
+        result.set_value(utils::transform_reduce(pool, values, 0, std::plus<>(), [](int v) { return v; }, options));
+    });
+    ASSERT_EQ(result.get_future().get(), 50000);
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include "small_function.h"
+
+using utils::SmallFunction;
+
+TEST(small_function, smallCaptureIsStoredInline) {
+    int base = 40;
+    SmallFunction<int(int)> f = [base](int i) { return base + i; };
+
+    ASSERT_TRUE(f);
+    ASSERT_FALSE(f.on_heap());
+    ASSERT_EQ(f(2), 42);
+}
+
+TEST(small_function, bigCaptureFallsBackToHeap) {
+    std::array<char, 128> big {};
+    big[127] = 'x';
+    SmallFunction<char()> f = [big]() { return big[127]; };
+
+    ASSERT_TRUE(f.on_heap());
+    ASSERT_EQ(f(), 'x');
+}
+
+TEST(small_function, moveTransfersTargetAndEmptiesSource) {
+    auto counter = std::make_shared<int>(0);
+    SmallFunction<void()> f = [counter]() { ++*counter; };
+    ASSERT_EQ(counter.use_count(), 2);
+
+    SmallFunction<void()> g = std::move(f);
+    ASSERT_FALSE(f);
+    ASSERT_EQ(counter.use_count(), 2);
+
+    g();
+    ASSERT_EQ(*counter, 1);
+
+    g.reset();
+    ASSERT_EQ(counter.use_count(), 1);
+}
+
+TEST(small_function, moveOnlyTargetsAreSupported) {
+    auto value = std::make_unique<std::string>("moved");
+    SmallFunction<std::string()> f = [value = std::move(value)]() { return *value; };
+
+    SmallFunction<std::string()> g;
+    g = std::move(f);
+    ASSERT_EQ(g(), "moved");
+}
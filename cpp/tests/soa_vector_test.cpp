@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "soa_vector.h"
+
+namespace {
+
+using Particles = utils::soa_vector<int, float, std::string>;
+
+bool aligned(const void* ptr) {
+    return reinterpret_cast<uintptr_t>(ptr) % Particles::column_alignment == 0;
+}
+
+} // namespace
+
+TEST(soa_vector_test, rows_go_into_aligned_columns_of_one_block) {
+    Particles particles;
+    particles.reserve(100);
+    for (int i = 0; i < 100; ++i) {
+        particles.push_back(std::make_tuple(i, i * 0.5f, std::to_string(i)));
+    }
+    ASSERT_EQ(particles.size(), 100u);
+    ASSERT_EQ(particles.capacity(), 100u);
+
+    const auto ids = particles.column<0>();
+    const auto speeds = particles.column<1>();
+    const auto names = particles.column<2>();
+    ASSERT_TRUE(aligned(ids.data()));
+    ASSERT_TRUE(aligned(speeds.data()));
+    ASSERT_TRUE(aligned(names.data()));
+    // one after another
+    ASSERT_GE(reinterpret_cast<const char*>(speeds.data()), reinterpret_cast<const char*>(ids.data() + 100));
+    ASSERT_GE(reinterpret_cast<const char*>(names.data()), reinterpret_cast<const char*>(speeds.data() + 100));
+    ASSERT_LT(reinterpret_cast<const char*>(names.data()) - reinterpret_cast<const char*>(ids.data()), 3 * 100 * 8);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(ids[i], i);
+        ASSERT_EQ(speeds[i], i * 0.5f);
+        ASSERT_EQ(names[i], std::to_string(i));
+    }
+}
+
+TEST(soa_vector_test, rows_read_and_write_through) {
+    Particles particles;
+    for (int i = 0; i < 20; ++i) {
+        particles.emplace_back(i, 1.0f, "particle");
+    }
+    ASSERT_GE(particles.capacity(), 20u);
+
+    std::get<2>(particles[3]) = "third";
+    particles[4] = std::make_tuple(-4, 2.0f, "fourth");
+    ASSERT_EQ(particles.column<2>()[3], "third");
+    ASSERT_EQ(std::get<0>(particles[4]), -4);
+
+    for (auto&& row : utils::zip(particles.column<0>(), particles.column<1>())) {
+        std::get<1>(row) *= std::get<0>(row);
+    }
+    ASSERT_EQ(particles.column<1>()[5], 5.0f);
+    ASSERT_EQ(particles.column<1>()[4], -8.0f);
+
+    int sum = 0;
+    const auto& view = particles;
+    for (auto&& row : view) {
+        sum += std::get<0>(row);
+    }
+    ASSERT_EQ(sum, 19 * 20 / 2 - 8);
+}
+
+TEST(soa_vector_test, push_back_of_its_own_row_while_growing) {
+    Particles particles;
+    particles.emplace_back(1, 1.0f, "a string long enough to live on the heap");
+    while (particles.size() < particles.capacity()) {
+        particles.emplace_back(0, 0.0f, "");
+    }
+    const auto capacity = particles.capacity();
+    particles.push_back(particles[0]);
+    ASSERT_GT(particles.capacity(), capacity);
+    ASSERT_EQ(std::get<2>(particles[particles.size() - 1]), "a string long enough to live on the heap");
+    ASSERT_EQ(std::get<2>(particles[0]), "a string long enough to live on the heap");
+}
+
+TEST(soa_vector_test, erase_moves_the_rest_down) {
+    Particles particles;
+    for (int i = 0; i < 10; ++i) {
+        particles.emplace_back(i, float(i), std::to_string(i));
+    }
+    auto next = particles.erase(particles.begin() + 2, particles.begin() + 5);
+    ASSERT_EQ(std::get<0>(*next), 5);
+    next = particles.erase(particles.begin());
+    ASSERT_EQ(std::get<0>(*next), 1);
+
+    ASSERT_EQ(particles.size(), 6u);
+    const std::vector<int> ids(particles.column<0>().begin(), particles.column<0>().end());
+    ASSERT_EQ(ids, (std::vector<int> { 1, 5, 6, 7, 8, 9 }));
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        ASSERT_EQ(particles.column<2>()[i], std::to_string(particles.column<0>()[i]));
+    }
+}
+
+TEST(soa_vector_test, sort_by_a_column_keeps_rows_together) {
+    Particles particles;
+    const int ids[] = { 5, 3, 9, 1, 7 };
+    for (const auto id : ids) {
+        particles.emplace_back(id, -float(id), std::to_string(id));
+    }
+
+    particles.sort_by<0>();
+    const std::vector<int> sorted(particles.column<0>().begin(), particles.column<0>().end());
+    ASSERT_EQ(sorted, (std::vector<int> { 1, 3, 5, 7, 9 }));
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        ASSERT_EQ(particles.column<1>()[i], -float(sorted[i]));
+        ASSERT_EQ(particles.column<2>()[i], std::to_string(sorted[i]));
+    }
+
+    particles.sort_by<2>(std::greater<std::string>());
+    ASSERT_EQ(particles.column<2>()[0], "9");
+    ASSERT_EQ(particles.column<0>()[0], 9);
+}
+
+TEST(soa_vector_test, sort_by_moves_the_fields) {
+    Particles particles;
+    for (int i = 0; i < 50; ++i) {
+        const auto id = (i * 13) % 50;
+        particles.emplace_back(id, float(id), "a name long enough to live on the heap, " + std::to_string(id));
+    }
+    // a moved string keeps its buffer, a copied one gets a new one
+    std::map<std::string, const char*> buffers;
+    for (const auto& name : particles.column<2>()) {
+        buffers[name] = name.data();
+    }
+
+    particles.sort_by<0>();
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        const auto& name = particles.column<2>()[i];
+        ASSERT_EQ(particles.column<0>()[i], int(i));
+        ASSERT_EQ(name, "a name long enough to live on the heap, " + std::to_string(i));
+        ASSERT_EQ(static_cast<const void*>(name.data()), static_cast<const void*>(buffers[name])) << i;
+    }
+}
+
+TEST(soa_vector_test, copies_and_moves) {
+    Particles particles;
+    particles.emplace_back(1, 1.0f, "one");
+    particles.emplace_back(2, 2.0f, "two");
+
+    Particles copy(particles);
+    std::get<2>(copy[0]) = "changed";
+    ASSERT_EQ(particles.column<2>()[0], "one");
+    ASSERT_EQ(copy.size(), 2u);
+
+    Particles moved(std::move(copy));
+    ASSERT_TRUE(copy.empty());
+    ASSERT_EQ(moved.column<2>()[0], "changed");
+
+    copy = moved;
+    particles = std::move(moved);
+    ASSERT_EQ(copy.column<2>()[1], "two");
+    ASSERT_EQ(particles.column<2>()[0], "changed");
+
+    particles.pop_back();
+    particles.clear();
+    ASSERT_TRUE(particles.empty());
+}
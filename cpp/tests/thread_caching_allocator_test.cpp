@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_caching_allocator.h"
+
+namespace {
+
+struct VectorArena
+    : public ArenaHolder {
+    explicit VectorArena(size_t n)
+        : block(n) {}
+    char *begin() noexcept override { return block.data(); }
+    size_t size() const noexcept override { return block.size(); }
+    std::vector<char> block;
+};
+
+}
+
+TEST(thread_caching_allocator, reusesFreedBlocksOfTheSameClass) {
+    VectorArena arena(1 << 20);
+    ThreadCachingAllocator allocator(arena);
+
+    const auto a = allocator.allocate(40);
+    const auto b = allocator.allocate(48);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    ASSERT_NE(a, b);
+    allocator.deallocate(a, 40);
+    ASSERT_EQ(allocator.allocate(33), a);
+
+    const auto big = allocator.allocate(64 * 1024);
+    ASSERT_GE(big, arena.begin());
+    ASSERT_LE(big + 64 * 1024, arena.begin() + arena.size());
+    allocator.deallocate(big, 64 * 1024);
+    allocator.deallocate(b, 48);
+}
+
+TEST(thread_caching_allocator, threadsNeverShareABlock) {
+    constexpr int threads = 4;
+    constexpr int rounds = 200;
+    constexpr int blocks = 100;
+
+    VectorArena arena(8 << 20);
+    ThreadCachingAllocator allocator(arena);
+    std::atomic<int> corrupted { 0 };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&allocator, &corrupted, t](){
+            std::vector<std::pair<char*, size_t>> mine;
+            for (int round = 0; round < rounds; ++round) {
+                for (int i = 0; i < blocks; ++i) {
+                    const size_t size = 1 + (i * 37 + round) % 1500;
+                    const auto ptr = allocator.allocate(size);
+                    ASSERT_NE(ptr, nullptr);
+                    std::memset(ptr, t + 1, size);
+                    mine.emplace_back(ptr, size);
+                }
+                for (const auto& block : mine) {
+                    const bool intact = std::all_of(block.first, block.first + block.second, [t](char c){
+                        return c == t + 1;
+                    });
+                    corrupted += intact ? 0 : 1;
+                    allocator.deallocate(block.first, block.second);
+                }
+                mine.clear();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    ASSERT_EQ(corrupted.load(), 0);
+}
+
+TEST(thread_caching_allocator, blocksFreedByOtherThreadsAreReused) {
+    constexpr size_t size = 64;
+    constexpr int rounds = 100;
+    constexpr int blocks = 1000;
+
+    // far less than rounds * blocks * size
+    VectorArena arena(1 << 20);
+    ThreadCachingAllocator allocator(arena);
+
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<char*> handed_over;
+        for (int i = 0; i < blocks; ++i) {
+            const auto ptr = allocator.allocate(size);
+            ASSERT_NE(ptr, nullptr) << "round " << round;
+            handed_over.push_back(ptr);
+        }
+        std::thread([&allocator, &handed_over](){
+            for (const auto ptr : handed_over) {
+                allocator.deallocate(ptr, size);
+            }
+        }).join();
+    }
+}
+
+TEST(thread_caching_allocator, exitedThreadsHandTheirCacheOn) {
+    VectorArena arena(1 << 20);
+    ThreadCachingAllocator allocator(arena);
+
+    for (int i = 0; i < 200; ++i) {
+        std::thread([&allocator](){
+            // keeps a run per thread if caches weren't reused
+            const auto ptr = allocator.allocate(100);
+            ASSERT_NE(ptr, nullptr);
+            allocator.deallocate(ptr, 100);
+        }).join();
+    }
+}
+
+TEST(thread_caching_allocator, threadsOutliveTheAllocatorsTheyUsed) {
+    VectorArena lasting_arena(1 << 20);
+    ThreadCachingAllocator lasting(lasting_arena);
+    const auto kept = lasting.allocate(32);
+    ASSERT_NE(kept, nullptr);
+
+    for (int i = 0; i < 100; ++i) {
+        VectorArena arena(1 << 20);
+        // the worker uses the allocator last, the main thread destroys it
+        auto allocator = std::make_unique<ThreadCachingAllocator>(arena);
+        const auto ptr = allocator->allocate(48);
+        ASSERT_NE(ptr, nullptr);
+        std::thread([&allocator, &lasting, ptr](){
+            allocator->deallocate(ptr, 48);
+            const auto own = allocator->allocate(48);
+            ASSERT_NE(own, nullptr);
+            allocator->deallocate(own, 48);
+            const auto other = lasting.allocate(48);
+            ASSERT_NE(other, nullptr);
+            lasting.deallocate(other, 48);
+        }).join();
+        allocator.reset();
+
+        // its lease went with it, the lasting allocator's is still there
+        const auto other = lasting.allocate(64);
+        ASSERT_NE(other, nullptr);
+        lasting.deallocate(other, 64);
+    }
+    lasting.deallocate(kept, 32);
+}
+
+namespace {
+
+// Frees its block when the thread exits, after the allocator's own
+// thread_local state is gone: it is made before the thread allocates.
+struct FreedAtExit {
+    ~FreedAtExit() {
+        if (allocator != nullptr) {
+            *allocated = allocator->allocate(64);
+            allocator->deallocate(block, 64);
+        }
+    }
+
+    ThreadCachingAllocator* allocator = nullptr;
+    char* block = nullptr;
+    char** allocated = nullptr;
+};
+
+}
+
+TEST(thread_caching_allocator, threadLocalDestructorsFreeLikeOtherThreads) {
+    VectorArena arena(1 << 20);
+    ThreadCachingAllocator allocator(arena);
+    char* freed = nullptr;
+    char* allocated = arena.begin();
+
+    std::thread([&allocator, &freed, &allocated](){
+        static thread_local FreedAtExit at_exit;
+        at_exit.allocator = &allocator;
+        at_exit.allocated = &allocated;
+        freed = allocator.allocate(64);
+        at_exit.block = freed;
+    }).join();
+    ASSERT_NE(freed, nullptr);
+    // the cache it had may be another thread's by then
+    ASSERT_EQ(allocated, nullptr);
+
+    // the next thread adopts the exited one's cache, and finds the block
+    // handed back to it once the rest of its run is used up
+    std::thread([&allocator, freed](){
+        bool found = false;
+        for (size_t i = 0; i < ThreadCachingAllocator::run_size / 64 + 1 && !found; ++i) {
+            found = allocator.allocate(64) == freed;
+        }
+        ASSERT_TRUE(found);
+    }).join();
+}
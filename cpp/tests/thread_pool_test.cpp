@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "thread_pool.h"
+
+TEST(thread_pool, runsEveryPostedTask) {
+    constexpr int tasks = 10000;
+
+    std::atomic<int> done { 0 };
+    std::promise<void> finished;
+    {
+        utils::ThreadPool pool(4);
+        for (int i = 0; i < tasks; ++i) {
+            pool.post([&done, &finished](){
+                if (done.fetch_add(1) + 1 == tasks) {
+                    finished.set_value();
+                }
+            });
+        }
+        finished.get_future().wait();
+    }
+    ASSERT_EQ(done.load(), tasks);
+}
+
+TEST(thread_pool, tasksSpawnedByWorkersAreStolenByIdleOnes) {
+    constexpr int fan_out = 64;
+
+    utils::ThreadPool pool(4);
+    std::atomic<int> done { 0 };
+    std::promise<void> finished;
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+
+    pool.post([&](){
+        // everything lands in this worker's own deque
+        for (int i = 0; i < fan_out; ++i) {
+            pool.post([&](){
+                ASSERT_TRUE(pool.in_worker());
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    threads.insert(std::this_thread::get_id());
+                }
+                if (done.fetch_add(1) + 1 == fan_out) {
+                    finished.set_value();
+                }
+            });
+        }
+    });
+
+    finished.get_future().wait();
+    ASSERT_GT(threads.size(), 1u);
+}
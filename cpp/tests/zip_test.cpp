@@ -5,8 +5,15 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
-#include <vector>
+#include <algorithm>
+#include <deque>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "zip.h"
 
@@ -45,4 +52,327 @@ TEST(zip_test, zip_with_containers_with_empty_one) {
     auto actual = make_zipped<std::vector<std::tuple<int, int>>>(a, b);
 
     ASSERT_THAT(actual, ContainerEq(std::vector<std::tuple<int, int>>()));
-}
\ No newline at end of file
+}
+
+namespace {
+
+struct Counted {
+    Counted(int value)
+        : value { value } {}
+
+    Counted(const Counted& other)
+        : value { other.value } {
+        ++copies;
+    }
+
+    Counted& operator=(const Counted& other) {
+        value = other.value;
+        ++copies;
+        return *this;
+    }
+
+    Counted(Counted&&) noexcept = default;
+    Counted& operator=(Counted&&) noexcept = default;
+
+    int value;
+    static int copies;
+};
+
+int Counted::copies = 0;
+
+}
+
+TEST(zip_test, zip_dereferences_to_references) {
+    using Iterator = decltype(utils::zip(std::declval<std::vector<int>&>(), std::declval<const std::vector<std::string>&>()).begin());
+    static_assert(std::is_same<std::iterator_traits<Iterator>::value_type, utils::__impl::ZipValue<int, std::string>>::value, "");
+    static_assert(std::is_base_of<std::tuple<int, std::string>, std::iterator_traits<Iterator>::value_type>::value, "");
+    static_assert(std::is_same<std::iterator_traits<Iterator>::reference, utils::__impl::ZipReference<int&, const std::string&>>::value, "");
+
+    std::vector<Counted> a { 1, 2, 3 };
+    std::list<Counted> b { 4, 5, 6 };
+    Counted::copies = 0;
+    int sum = 0;
+    for (auto&& row : utils::zip(a, b)) {
+        sum += std::get<0>(row).value * std::get<1>(row).value;
+    }
+    ASSERT_EQ(sum, 4 + 10 + 18);
+    ASSERT_EQ(Counted::copies, 0);
+}
+
+TEST(zip_test, zip_writes_through_to_the_containers) {
+    std::vector<int> a { 1, 2, 3 };
+    std::list<std::string> b { "one", "two", "three", "four" };
+
+    for (auto&& row : utils::zip(a, b)) {
+        std::get<0>(row) *= 10;
+        std::get<1>(row) += "!";
+    }
+    ASSERT_THAT(a, ContainerEq(std::vector<int> { 10, 20, 30 }));
+    ASSERT_THAT(b, ContainerEq(std::list<std::string> { "one!", "two!", "three!", "four" }));
+
+    auto zipped = utils::zip(a, b);
+    auto first = zipped.begin();
+    auto second = std::next(first);
+    *first = std::make_tuple(7, "seven");
+    auto&& source = *first;
+    *second = source;
+    ASSERT_THAT(a, ContainerEq(std::vector<int> { 7, 7, 30 }));
+    ASSERT_THAT(b, ContainerEq(std::list<std::string> { "seven", "seven", "three!", "four" }));
+}
+
+TEST(zip_test, zip_elements_can_be_moved_from) {
+    std::vector<std::string> a { "a long enough string not to fit inline" };
+    std::vector<std::string> b { "another one, long enough not to fit inline" };
+    auto zipped = utils::zip(a, b);
+
+    std::tuple<std::string, std::string> copied = *zipped.begin();
+    ASSERT_EQ(std::get<0>(copied), a[0]);
+
+    std::tuple<std::string, std::string> moved = iter_move(zipped.begin());
+    ASSERT_EQ(std::get<0>(moved), "a long enough string not to fit inline");
+    ASSERT_EQ(std::get<1>(moved), "another one, long enough not to fit inline");
+    ASSERT_TRUE(a[0].empty());
+    ASSERT_TRUE(b[0].empty());
+
+    // and moved back in
+    *zipped.begin() = std::move(moved);
+    ASSERT_EQ(a[0], "a long enough string not to fit inline");
+    ASSERT_TRUE(std::get<0>(moved).empty());
+}
+
+TEST(zip_test, zip_moves_rows_without_copying_the_elements) {
+    std::vector<int> a { 1, 2, 3 };
+    std::vector<Counted> b { 10, 20, 30 };
+    std::list<int> c(3);
+    std::list<Counted> d(3, Counted(0));
+    auto from = utils::zip(a, b);
+    auto to = utils::zip(c, d);
+
+    Counted::copies = 0;
+    std::move(from.begin(), from.end(), to.begin());
+    ASSERT_THAT(c, ContainerEq(std::list<int> { 1, 2, 3 }));
+    ASSERT_EQ(std::next(d.begin())->value, 20);
+
+    // a value made from a dereferenced row takes the elements over
+    decltype(to.begin())::value_type taken = *to.begin();
+    ASSERT_EQ(std::get<1>(taken).value, 10);
+    ASSERT_EQ(Counted::copies, 0);
+
+    // while one made from a named row copies them
+    auto&& row = *to.begin();
+    decltype(to.begin())::value_type copied = row;
+    ASSERT_EQ(Counted::copies, 1);
+    ASSERT_EQ(std::get<0>(copied), 1);
+}
+
+TEST(zip_test, zip_moves_a_move_only_column) {
+    std::vector<int> a { 1, 2, 3 };
+    std::vector<std::unique_ptr<int>> b;
+    for (auto value : a) {
+        b.emplace_back(new int(value * 100));
+    }
+    std::list<int> c(3);
+    std::list<std::unique_ptr<int>> d(3);
+    auto to = utils::zip(c, d);
+
+    std::move(utils::zip(a, b).begin(), utils::zip(a, b).end(), to.begin());
+    int expected = 100;
+    for (auto&& row : to) {
+        ASSERT_EQ(*std::get<1>(row), expected);
+        expected += 100;
+    }
+    for (const auto& moved : b) {
+        ASSERT_EQ(moved, nullptr);
+    }
+}
+
+TEST(zip_test, zip_takes_the_weakest_category) {
+    using Vectors = decltype(utils::zip(std::declval<std::vector<int>&>(), std::declval<std::vector<double>&>()).begin());
+    using WithList = decltype(utils::zip(std::declval<std::vector<int>&>(), std::declval<std::list<double>&>()).begin());
+    static_assert(std::is_same<std::iterator_traits<Vectors>::iterator_category, std::random_access_iterator_tag>::value, "");
+    static_assert(std::is_same<std::iterator_traits<WithList>::iterator_category, std::bidirectional_iterator_tag>::value, "");
+
+    std::vector<int> a { 1, 2, 3, 4, 5 };
+    std::vector<double> b { 0.5, 1.5, 2.5 };
+    auto zipped = utils::zip(a, b);
+    ASSERT_EQ(std::distance(zipped.begin(), zipped.end()), 3);
+    ASSERT_EQ(std::get<0>(zipped.begin()[2]), 3);
+    ASSERT_EQ(std::get<1>(*(zipped.end() - 1)), 2.5);
+    ASSERT_TRUE(zipped.begin() < zipped.end());
+    ASSERT_TRUE(zipped.begin() + 3 == zipped.end());
+}
+
+TEST(zip_test, zip_walks_back_from_the_shortest_end) {
+    std::list<int> a { 1, 2, 3, 4, 5 };
+    std::vector<std::string> b { "one", "two", "three" };
+    auto zipped = utils::zip(a, b);
+
+    std::vector<std::tuple<int, std::string>> reversed;
+    for (auto it = zipped.end(); it != zipped.begin();) {
+        --it;
+        reversed.emplace_back(*it);
+    }
+    ASSERT_THAT(reversed, ContainerEq(std::vector<std::tuple<int, std::string>> {
+            std::make_tuple(3, "three"),
+            std::make_tuple(2, "two"),
+            std::make_tuple(1, "one")
+    }));
+}
+
+TEST(zip_test, zip_sorts_parallel_vectors_by_key) {
+    std::vector<int> keys { 3, 1, 4, 1, 5, 9, 2, 6 };
+    std::vector<std::string> names { "c", "a", "d", "a'", "e", "i", "b", "f" };
+    std::vector<double> weights { 3.0, 1.0, 4.0, 1.5, 5.0, 9.0, 2.0, 6.0 };
+    auto zipped = utils::zip(keys, names, weights);
+
+    std::sort(zipped.begin(), zipped.end(), [](const auto& lhs, const auto& rhs) {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+    });
+    ASSERT_THAT(keys, ContainerEq(std::vector<int> { 1, 1, 2, 3, 4, 5, 6, 9 }));
+    // the rows stay together
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(int(weights[i]), keys[i]) << i;
+        ASSERT_EQ(names[i][0], 'a' + keys[i] - 1) << i;
+        ASSERT_EQ(names[i].size() > 1, weights[i] == 1.5) << i;
+    }
+
+    // and looked up by the key once sorted
+    const auto found = std::lower_bound(zipped.begin(), zipped.end(), 5, [](const auto& row, int key) {
+        return std::get<0>(row) < key;
+    });
+    ASSERT_EQ(found - zipped.begin(), 5);
+    ASSERT_EQ(std::get<1>(*found), "e");
+}
+
+TEST(zip_test, zip_swaps_rows) {
+    std::vector<std::string> a { "first", "second" };
+    std::vector<int> b { 1, 2 };
+    auto zipped = utils::zip(a, b);
+
+    std::iter_swap(zipped.begin(), zipped.begin() + 1);
+    ASSERT_THAT(a, ContainerEq(std::vector<std::string> { "second", "first" }));
+    ASSERT_THAT(b, ContainerEq(std::vector<int> { 2, 1 }));
+}
+
+TEST(zip_test, zip_is_as_long_as_the_shortest_random_access_range) {
+    std::vector<float> a { 1.0f, 2.0f, 3.0f, 4.0f };
+    const int b[] = { 10, 20, 30 };
+    std::deque<double> c { 0.5, 0.25, 0.125, 0.0625, 0.03125 };
+    auto zipped = utils::zip(a, b, c);
+    ASSERT_EQ(zipped.size(), 3u);
+
+    for (auto&& row : zipped) {
+        std::get<0>(row) *= std::get<1>(row) * std::get<2>(row);
+    }
+    ASSERT_THAT(a, ContainerEq(std::vector<float> { 5.0f, 10.0f, 11.25f, 4.0f }));
+    ASSERT_EQ(std::get<2>(*(zipped.end() - 1)), 0.125);
+}
+
+namespace {
+
+// A list whose iterators count the steps taken over it.
+struct StepCountingList {
+    using value_type = int;
+
+    class iterator {
+    public:
+        using value_type = int;
+        using reference = int&;
+        using pointer = int*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        iterator(std::list<int>::iterator position, std::size_t* steps)
+            : position(position), steps(steps) {}
+
+        int& operator*() const { return *position; }
+        iterator& operator++() { ++*steps; ++position; return *this; }
+        iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+        iterator& operator--() { ++*steps; --position; return *this; }
+        iterator operator--(int) { auto copy = *this; --*this; return copy; }
+        bool operator==(const iterator& other) const { return position == other.position; }
+        bool operator!=(const iterator& other) const { return position != other.position; }
+
+    private:
+        std::list<int>::iterator position;
+        std::size_t* steps;
+    };
+
+    iterator begin() { return iterator(items.begin(), &steps); }
+    iterator end() { return iterator(items.end(), &steps); }
+
+    std::list<int> items;
+    std::size_t steps = 0;
+};
+
+}
+
+TEST(zip_test, zip_walks_nothing_until_stepped_back_from_the_end) {
+    StepCountingList a { { 1, 2, 3, 4, 5 } };
+    std::vector<std::string> b { "one", "two", "three" };
+    auto zipped = utils::zip(a, b);
+    ASSERT_EQ(a.steps, 0u);
+
+    std::size_t rows = 0;
+    for (auto it = zipped.begin(); it != zipped.end(); ++it) {
+        ++rows;
+    }
+    ASSERT_EQ(rows, 3u);
+    ASSERT_EQ(a.steps, 3u);
+
+    a.steps = 0;
+    auto last = zipped.end();
+    --last;
+    ASSERT_EQ(std::get<0>(*last), 3);
+    ASSERT_EQ(std::get<1>(*last), "three");
+    // lined up once, stepped back from then on
+    const auto lined_up = a.steps;
+    --last;
+    ASSERT_EQ(a.steps, lined_up + 1);
+    ASSERT_EQ(std::get<1>(*last), "two");
+    ASSERT_TRUE(++++last == zipped.end());
+}
+
+TEST(zip_test, zip_sorts_without_copying_the_elements) {
+    std::vector<int> keys(20);
+    std::vector<Counted> payloads;
+    for (int i = 0; i < 20; ++i) {
+        keys[i] = (i * 7) % 20;
+        payloads.emplace_back(keys[i] * 10);
+    }
+    auto zipped = utils::zip(keys, payloads);
+
+    Counted::copies = 0;
+    std::sort(zipped.begin(), zipped.end(), [](const auto& lhs, const auto& rhs) {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+    });
+    ASSERT_EQ(Counted::copies, 0);
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQ(keys[i], i);
+        ASSERT_EQ(payloads[i].value, i * 10);
+    }
+
+    // a value taken out of a named row is a copy, the row stays as it is
+    auto&& row = *zipped.begin();
+    const decltype(zipped.begin())::value_type copy = row;
+    ASSERT_EQ(Counted::copies, 1);
+    ASSERT_EQ(std::get<1>(copy).value, 0);
+}
+
+TEST(zip_test, zip_sorts_a_move_only_column) {
+    std::vector<int> keys { 4, 2, 5, 1, 3 };
+    std::vector<std::unique_ptr<int>> values;
+    for (const auto key : keys) {
+        values.emplace_back(new int(key * 100));
+    }
+    auto zipped = utils::zip(keys, values);
+
+    std::sort(zipped.begin(), zipped.end(), [](const auto& lhs, const auto& rhs) {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+    });
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQ(keys[i], i + 1);
+        ASSERT_NE(values[i], nullptr);
+        ASSERT_EQ(*values[i], (i + 1) * 100);
+    }
+}